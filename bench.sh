@@ -0,0 +1,41 @@
+#!/bin/sh
+# Runs tabbench against a fresh tabbed on a private Xvfb for every tab
+# count in TABS.  See LICENSE file for copyright and license details.
+
+TABS=${TABS:-"1 10 100 1000"}
+ROUNDS=${ROUNDS:-200}
+DPY=${DPY:-:97}
+
+tmp=$(mktemp -d) || exit 1
+xvfb=
+tabbed=
+trap 'kill $tabbed $xvfb 2>/dev/null; rm -rf "$tmp"' EXIT INT TERM
+
+Xvfb "$DPY" -screen 0 1280x1024x24 -nolisten tcp 2>"$tmp/xvfb" &
+xvfb=$!
+export DISPLAY=$DPY
+
+for n in $TABS; do
+	./tabbed -s >"$tmp/xid" 2>"$tmp/log" &
+	tabbed=$!
+	# wait for Xvfb and tabbed to come up
+	for i in $(seq 50); do
+		[ -s "$tmp/xid" ] && break
+		if ! kill -0 $tabbed 2>/dev/null; then
+			./tabbed -s >"$tmp/xid" 2>"$tmp/log" &
+			tabbed=$!
+		fi
+		sleep 0.1
+	done
+	if [ ! -s "$tmp/xid" ]; then
+		echo "bench: tabbed did not start" >&2
+		cat "$tmp/xvfb" "$tmp/log" >&2
+		exit 1
+	fi
+	./tabbench -n "$n" -r "$ROUNDS" -p $tabbed -l "$tmp/log" \
+		"$(cat "$tmp/xid")" || exit 1
+	kill $tabbed
+	wait $tabbed 2>/dev/null
+	tabbed=
+	: >"$tmp/xid"
+done
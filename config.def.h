@@ -15,6 +15,51 @@ static const int  tabwidth      = 200;
 static const Bool foreground    = True;
 static       Bool urgentswitch  = False;
 
+/*
+ * Minimum interval in milliseconds between two title updates of the
+ * selected tab and of the other tabs. Titles set in between are dropped,
+ * the last one is applied when the interval has passed.
+ */
+static const int seltitleinterval = 100;
+static const int titleinterval    = 1000;
+
+/*
+ * Time in milliseconds the size of tabbed must be stable before the
+ * selected client is resized to it.
+ */
+static const int resizedelay = 50;
+
+/*
+ * When bgresize is True, hidden tabs are resized to the new size of tabbed
+ * in idle time, most recently used first, so switching to them is instant.
+ * One tab is resized after every bgresizedelay milliseconds without input.
+ */
+static const Bool bgresize      = False;
+static const int  bgresizedelay = 100;
+
+/*
+ * Number of clients spawned ahead of time and kept embedded but hidden, so
+ * that opening a new tab does not wait for the command to start. They are
+ * recognised by _NET_WM_PID, the pool is turned off for clients which do
+ * not set it.
+ */
+static const int poolsize = 0;
+
+/*
+ * Bytes of X server memory used to keep rendered tab labels, in all colour
+ * schemes together, so they can be copied instead of drawn again. 0
+ * disables it.
+ */
+static const unsigned long labelcachesize = 4 * 1024 * 1024;
+
+/*
+ * Number of events the flight recorder keeps, in the order they arrived,
+ * 0 disables it. They are written to tracefile on SIGUSR2 and when tabbed
+ * crashes, and can be replayed with tabreplay.
+ */
+static const unsigned long tracesize = 0;
+static const char tracefile[] = "/tmp/tabbed.trace";
+
 /*
  * Where to place a new tab when it is opened. When npisrelative is True,
  * then the current position is changed + newposition. If npisrelative
@@ -3,21 +3,27 @@
  */
 
 #include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <locale.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
+#include <X11/Xlibint.h>
 #include <X11/Xproto.h>
 #include <X11/Xutil.h>
-#include <X11/XKBlib.h>
 #include <X11/Xft/Xft.h>
 
 #include "arg.h"
+#include "tabs.h"
+#include "trace.h"
 
 /* XEMBED messages */
 #define XEMBED_EMBEDDED_NOTIFY          0
@@ -46,10 +52,19 @@
 #define LENGTH(x)               (sizeof((x)) / sizeof(*(x)))
 #define CLEANMASK(mask)         (mask & ~(numlockmask | LockMask))
 #define TEXTW(x)                (textnw(x, strlen(x)) + dc.font.height)
+#define WINHASH(w)              ((((w) >> 16) ^ (w)) * 2654435761UL)
+#define HISTLEN                 10 /* latency buckets, <4us up to >=256ms */
 
 enum { ColFG, ColBG, ColLast };       /* color */
 enum { WMProtocols, WMDelete, WMName, WMState, WMFullscreen,
-       XEmbed, WMSelectTab, WMLast }; /* default atoms */
+       XEmbed, WMSelectTab, Utf8String, WMPid, WMLast }; /* default atoms */
+enum { XFd, SignalFd, FdLast };       /* polled file descriptors */
+enum { TitleTimer, ResizeTimer, BgResizeTimer, TimerLast }; /* timers */
+enum { EvStruct, EvInput, EvLow, EvLast }; /* event priority classes */
+enum { PathFocus, PathResize, PathXEmbed, PathDraw, PathSwitch,
+       PathLast }; /* timed code paths */
+enum { ActNone, ActSpawn, ActSwitch, ActClose, ActRetitle,
+       ActLast }; /* actions X traffic is accounted to */
 
 typedef union {
 	int i;
@@ -63,13 +78,24 @@ typedef struct {
 	const Arg arg;
 } Key;
 
+typedef struct {
+	int n;                  /* number of boundaries, 0 if stale */
+	unsigned char off[256]; /* byte offsets of codepoint boundaries */
+	int w[256];             /* textnw() up to off[i], -1 if not measured */
+} Extents; /* prefix advances of a string */
+
 typedef struct {
 	int x, y, w, h;
 	XftColor norm[ColLast];
 	XftColor sel[ColLast];
 	XftColor urg[ColLast];
 	Drawable drawable;
+	int dw;              /* width of drawable, which is bh high */
+	XftDraw *xftdraw;
 	GC gc;
+	int beforew, afterw; /* cached TEXTW(before), TEXTW(after) */
+	int trimw;           /* cached textnw(titletrim) */
+	Extents beforeext, afterext;
 	struct {
 		int ascent;
 		int descent;
@@ -78,25 +104,76 @@ typedef struct {
 	} font;
 } DC; /* draw context */
 
-typedef struct {
+typedef struct Client {
 	char name[256];
 	Window win;
-	int tabx;
+	int x, y, w, h; /* geometry last configured by us, w is 0 if unknown */
+	unsigned long used; /* value of focusclock when last focused */
+	int tabnum; /* tab number label was measured for, 0 if stale */
+	Extents label;
 	Bool urgent;
 	Bool closed;
+	int candelete; /* WM_PROTOCOLS has WM_DELETE_WINDOW, -1 if unknown */
+	XWMHints hints; /* last WM_HINTS seen */
+	Bool titlepending; /* title changed, update is deferred */
+	long long titlet;  /* time of the last title update, in ms */
+	struct Client *next; /* free list link */
 } Client;
 
+typedef struct {
+	int x, w;
+	unsigned long long hash; /* of the text */
+	XftColor *col;
+} Cell; /* what a part of the bar pixmap shows, w is 0 if unknown */
+
+typedef struct {
+	unsigned long long hash;
+	int w;
+	XftColor *col;
+	Pixmap pm;
+	unsigned long used; /* value of pixclock when last copied */
+	int next; /* in its hash bucket, -1 at the end */
+} Pix; /* rendered label kept on the server */
+
+typedef struct {
+	Window win; /* None if the slot is free */
+	int c;
+} Slot; /* entry of the window to client index */
+
+typedef struct {
+	unsigned long n; /* events handled or actions run */
+	unsigned long requests, roundtrips, bytes;
+} Traffic; /* X protocol traffic caused by an event type or action */
+
+typedef struct {
+	unsigned long n;
+	unsigned long long us; /* total */
+	unsigned long b[HISTLEN]; /* b[i] counts times below 4^(i + 1) us */
+} Hist;
+
 /* function declarations */
+static int actstart(int a);
+static void addtab(Window w);
 static void buttonpress(const XEvent *e);
 static void cleanup(void);
+static Client *clientalloc(void);
+static void clientfree(Client *c);
 static void clientmessage(const XEvent *e);
+static int clienty(void);
 static void configurenotify(const XEvent *e);
 static void configurerequest(const XEvent *e);
 static void createnotify(const XEvent *e);
 static void destroynotify(const XEvent *e);
+static void damage(int x, int w);
+static void decide(int p, Bool mapping);
 static void die(const char *errstr, ...);
 static void drawbar(void);
-static void drawtext(const char *text, XftColor col[ColLast]);
+static void drawcell(int i, const char *text, XftColor col[ColLast],
+                     Extents *e);
+static void drawtext(const char *text, XftColor col[ColLast], Extents *e);
+static void dumphist(const char *name, const Hist *h);
+static void dumpstats(void);
+static void dumptraffic(const Traffic *t);
 static void *ecalloc(size_t n, size_t size);
 static void *erealloc(void *o, size_t size);
 static void expose(const XEvent *e);
@@ -104,36 +181,72 @@ static void focus(int c);
 static void focusin(const XEvent *e);
 static void focusonce(const Arg *arg);
 static void focusurgent(const Arg *arg);
+static pid_t forkcmd(char **argv);
 static void fullscreen(const Arg *arg);
 static char *getatom(int a);
 static int getclient(Window w);
 static XftColor getcolor(const char *colstr);
-static int getfirsttab(void);
+static void getextents(const char *text, Extents *e);
+static int getpending(Window w);
+static int getpooled(Window w);
 static Bool gettextprop(Window w, Atom atom, char *text, unsigned int size);
+static void histadd(Hist *h, long long us);
+static void indexdel(Window w);
+static void indexset(Window w, int c);
+static Slot *indexslot(Window w);
 static void initfont(const char *fontstr);
-static Bool isprotodel(int c);
+static Bool isprotodel(Window w);
 static void keypress(const XEvent *e);
 static void killclient(const Arg *arg);
 static void manage(Window win);
+static void mappingnotify(const XEvent *e);
 static void maprequest(const XEvent *e);
 static void move(const Arg *arg);
 static void movetab(const Arg *arg);
+static Bool pixcopy(unsigned long long hash, XftColor col[ColLast]);
+static void pixindex(void);
+static void pixstore(unsigned long long hash, XftColor col[ColLast]);
+static Bool placed(int c);
+static void poolfill(void);
+static void processevents(void);
 static void propertynotify(const XEvent *e);
-static void resize(int c, int w, int h);
+static void reindex(int from, int to);
+static void resize(int c);
+static void resizehidden(void);
+static void resizesel(void);
 static void rotate(const Arg *arg);
 static void run(void);
 static void sendxembed(int c, long msg, long detail, long d1, long d2);
 static void setcmd(int argc, char *argv[], int);
 static void setup(void);
-static void sigchld(int unused);
+static void settimer(int t, int ms);
+static void sigcrash(int sig);
+static void sighandler(int sig);
+static void signals(void);
 static void spawn(const Arg *arg);
+static int textextent(const char *text, Extents *e, int i);
+static long long timems(void);
+static long long timeus(void);
+static int timersrun(void);
+static void titlechanged(int c);
 static int textnw(const char *text, unsigned int len);
 static void toggle(const Arg *arg);
+static void traceadd(const XEvent *e, long long t);
+static void tracedone(unsigned long n, long long dur);
+static void tracedump(void);
+static Bool tracewrite(int fd, const void *p, size_t n);
 static void unmanage(int c);
 static void unmapnotify(const XEvent *e);
+static void updatekeys(void);
 static void updatenumlockmask(void);
 static void updatetitle(int c);
+static void updatetitles(void);
+static size_t utf8len(const unsigned char *s, size_t n);
+static int xafter(Display *dpy);
 static int xerror(Display *dpy, XErrorEvent *ee);
+static pid_t winpid(Window w);
+static void xflushed(Display *dpy, XExtCodes *codes, const char *data,
+                     long len);
 static void xsettitle(Window w, const char *str);
 
 /* variables */
@@ -149,20 +262,63 @@ static void (*handler[LASTEvent]) (const XEvent *) = {
 	[Expose] = expose,
 	[FocusIn] = focusin,
 	[KeyPress] = keypress,
+	[MappingNotify] = mappingnotify,
 	[MapRequest] = maprequest,
 	[PropertyNotify] = propertynotify,
 };
+static int evclass[LASTEvent] = {
+	[ButtonPress] = EvInput,
+	[FocusIn] = EvInput,
+	[KeyPress] = EvInput,
+	[ConfigureNotify] = EvLow,
+	[ConfigureRequest] = EvLow,
+	[Expose] = EvLow,
+	[PropertyNotify] = EvLow,
+};
+static XEvent *evq[EvLast];
+static unsigned long *evqtrace[EvLast]; /* recorder entry of each event */
+static int nevq[EvLast], evqcap[EvLast];
 static int bh, wx, wy, ww, wh;
 static unsigned int numlockmask;
 static Bool running = True, nextfocus, doinitspawn = True,
             fillagain = False, closelastclient = False,
-            killclientsfirst = False;
+            killclientsfirst = False, redraw = False;
 static Display *dpy;
 static DC dc;
 static Atom wmatom[WMLast];
 static Window root, win;
-static Client **clients;
-static int nclients, sel = -1, lastsel = -1;
+static Tabs tabs = { .size = sizeof(Client *), .sel = -1, .lastsel = -1 };
+static Client **clients; /* tabs.v */
+static Client *slabs[24], *freeclients; /* slab k holds 16 << k clients */
+static int nslabs;
+static int ntitlespending;
+static Window *pool;    /* hidden clients, oldest first */
+static pid_t *poolpids; /* spawned for the pool, not yet embedded */
+static int npool, npoolpids;
+static Window *pending; /* embedded, waiting for _NET_WM_PID */
+static int npending, npendingcap;
+static Bool pooloff; /* cmd does not seem to set _NET_WM_PID */
+static Bool pooltied; /* a window was tied to a pool client by its pid */
+static unsigned long focusclock;
+static XWMHints winhints; /* WM_HINTS of win */
+static Cell *cells; /* 0: after, 1: before, 2...: visible tabs */
+static int ncells; /* allocated length of cells */
+static int dmgx0, dmgx1; /* part of the bar to copy to win */
+static Pix *pixes;
+static int *pixhead; /* first of each hash bucket, 2 * pixcap of them */
+static int npixes, pixcap;
+static unsigned long pixbytes, pixclock;
+static int sigpipe[2]; /* written by sighandler(), read by signals() */
+static TraceEvent *trace; /* ring of the last handled events */
+static unsigned long ntrace, tracelen; /* events recorded, ring length */
+static void (*timer[TimerLast])(void) = {
+	[TitleTimer] = updatetitles,
+	[ResizeTimer] = resizesel,
+	[BgResizeTimer] = resizehidden,
+};
+static long long timerdue[TimerLast]; /* in ms, 0 if not armed */
+static Slot *winindex; /* open addressing, linear probing */
+static int nwinindex, nslots;
 static int (*xerrorxlib)(Display *, XErrorEvent *);
 static int cmd_append_pos;
 static char winid[64];
@@ -173,42 +329,153 @@ static const char *geometry;
 static Colormap cmap;
 static Visual *visual = NULL;
 
+/* statistics, dumped to stderr on SIGUSR1 */
+static const char *evname[LASTEvent] = {
+	[0] = "other",
+	[ButtonPress] = "ButtonPress",
+	[ClientMessage] = "ClientMessage",
+	[ConfigureNotify] = "ConfigureNotify",
+	[ConfigureRequest] = "ConfigureRequest",
+	[CreateNotify] = "CreateNotify",
+	[UnmapNotify] = "UnmapNotify",
+	[DestroyNotify] = "DestroyNotify",
+	[Expose] = "Expose",
+	[FocusIn] = "FocusIn",
+	[KeyPress] = "KeyPress",
+	[MappingNotify] = "MappingNotify",
+	[MapRequest] = "MapRequest",
+	[PropertyNotify] = "PropertyNotify",
+};
+static const char *pathname[PathLast] = {
+	[PathFocus] = "focus",
+	[PathResize] = "focus resize",
+	[PathXEmbed] = "focus xembed",
+	[PathDraw] = "drawbar",
+	[PathSwitch] = "switch",
+};
+static const char *actname[ActLast] = {
+	[ActSpawn] = "spawn",
+	[ActSwitch] = "switch",
+	[ActClose] = "close",
+	[ActRetitle] = "retitle",
+};
+static struct {
+	Traffic evx[LASTEvent];
+	Traffic actx[ActLast];
+	unsigned long xerrors;
+	unsigned long allocs; /* heap allocations for client storage */
+	unsigned long titlesdropped;
+	unsigned long evcoalesced;
+	unsigned long configskipped;
+	unsigned long poolhits, poolmisses;
+	unsigned long frames, pixels, lastpixels; /* bar pixels rendered */
+	unsigned long pixhits, pixmisses;
+	Hist evlat[LASTEvent]; /* handler run times */
+	Hist pathlat[PathLast];
+} stats;
+static int curev; /* event type being handled, 0 outside of handlers */
+static int curact; /* action being run, ActNone outside of them */
+static long long evstart; /* in us, when the handler started, or 0 */
+static long long switchstart; /* in us, when the selected tab changed */
+static unsigned long lastread, lastreq, lastbytes; /* at last xafter() */
+static unsigned long xsent; /* bytes flushed to the server */
+
 char *argv0;
 
 /* configuration, allows nested code to access above variables */
 #include "config.h"
 
+/* keys[] bound to a keycode, chained in order, built by updatekeys() */
+static unsigned int keyhead[256]; /* 1 + index of the first key, 0 if none */
+static unsigned int keynext[LENGTH(keys)];
+
+/* Accounts the X traffic up to the restoring of curact to the action a,
+ * unless it is part of another action.  Returns the action to restore.  */
+int
+actstart(int a)
+{
+	int prev = curact;
+
+	if (!curact) {
+		curact = a;
+		stats.actx[a].n++;
+	}
+
+	return prev;
+}
+
+void
+addtab(Window w)
+{
+	int nextpos, cap = tabs.cap;
+	Client *c;
+	XWMHints *wmh;
+
+	c = clientalloc();
+	c->win = w;
+	c->y = bh;
+	c->candelete = -1; /* fetched when it is first closed */
+	/* focus() writes these back, they must not start out empty */
+	if ((wmh = XGetWMHints(dpy, w))) {
+		c->hints = *wmh;
+		XFree(wmh);
+	}
+
+	if(npisrelative) {
+		nextpos = tabs.sel + newposition;
+	} else {
+		if (newposition < 0)
+			nextpos = tabs.n + 1 - newposition;
+		else
+			nextpos = newposition;
+	}
+
+	/* this also adjusts sel before focus does set it to lastsel */
+	if ((nextpos = tabsinsert(&tabs, &c, nextpos)) < 0)
+		die("%s: cannot allocate memory\n", argv0);
+	clients = tabs.v;
+	if (tabs.cap != cap)
+		stats.allocs++;
+	reindex(nextpos, tabs.n);
+	updatetitle(nextpos);
+
+	XLowerWindow(dpy, w);
+	XMapWindow(dpy, w);
+
+	focus(nextfocus ? nextpos :
+	      tabs.sel < 0 ? 0 :
+	      tabs.sel);
+	nextfocus = foreground;
+}
+
 void
 buttonpress(const XEvent *e)
 {
 	const XButtonPressedEvent *ev = &e->xbutton;
-	int i, fc;
+	TabsView v;
+	int i;
 	Arg arg;
 
 	if (ev->y < 0 || ev->y > bh)
 		return;
 
-	if (((fc = getfirsttab()) > 0 && ev->x < TEXTW(before)) || ev->x < 0)
+	tabsview(&tabs, &v, ww, tabwidth, dc.beforew, dc.afterw);
+	if ((i = tabsat(&tabs, &v, ev->x)) < 0)
 		return;
 
-	for (i = fc; i < nclients; i++) {
-		if (clients[i]->tabx > ev->x) {
-			switch (ev->button) {
-			case Button1:
-				focus(i);
-				break;
-			case Button2:
-				focus(i);
-				killclient(NULL);
-				break;
-			case Button4: /* FALLTHROUGH */
-			case Button5:
-				arg.i = ev->button == Button4 ? -1 : 1;
-				rotate(&arg);
-				break;
-			}
-			break;
-		}
+	switch (ev->button) {
+	case Button1:
+		focus(i);
+		break;
+	case Button2:
+		focus(i);
+		killclient(NULL);
+		break;
+	case Button4: /* FALLTHROUGH */
+	case Button5:
+		arg.i = ev->button == Button4 ? -1 : 1;
+		rotate(&arg);
+		break;
 	}
 }
 
@@ -217,15 +484,37 @@ cleanup(void)
 {
 	int i;
 
-	for (i = 0; i < nclients; i++) {
+	for (i = 0; i < tabs.n; i++) {
 		focus(i);
 		killclient(NULL);
 		XReparentWindow(dpy, clients[i]->win, root, 0, 0);
 		unmanage(i);
 	}
-	free(clients);
-	clients = NULL;
+	for (i = 0; i < npool; i++)
+		XKillClient(dpy, pool[i]);
+	for (i = 0; i < npending; i++)
+		XKillClient(dpy, pending[i]);
+	free(pool);
+	free(poolpids);
+	free(pending);
+	free(tabs.v);
+	clients = tabs.v = NULL;
+	for (i = 0; i < nslabs; i++)
+		free(slabs[i]);
+	free(winindex);
+	winindex = NULL;
+	free(cells);
+	free(trace);
+	for (i = 0; i < npixes; i++)
+		XFreePixmap(dpy, pixes[i].pm);
+	free(pixes);
+	free(pixhead);
+	for (i = 0; i < EvLast; i++) {
+		free(evq[i]);
+		free(evqtrace[i]);
+	}
 
+	XftDrawDestroy(dc.xftdraw);
 	XFreePixmap(dpy, dc.drawable);
 	XFreeGC(dpy, dc.gc);
 	XDestroyWindow(dpy, win);
@@ -233,6 +522,41 @@ cleanup(void)
 	free(cmd);
 }
 
+/* Clients are carved out of slabs of geometrically growing size and
+ * recycled through a free list, so opening and closing tabs does not hit
+ * the heap once enough slabs exist.  */
+Client *
+clientalloc(void)
+{
+	Client *c;
+	int i, n;
+
+	if (!freeclients) {
+		if (nslabs == LENGTH(slabs))
+			die("%s: too many clients\n", argv0);
+		n = 16 << nslabs;
+		c = slabs[nslabs++] = ecalloc(n, sizeof(*c));
+		stats.allocs++;
+		for (i = n - 1; i >= 0; i--) {
+			c[i].next = freeclients;
+			freeclients = &c[i];
+		}
+	}
+
+	c = freeclients;
+	freeclients = c->next;
+	memset(c, 0, sizeof(*c));
+
+	return c;
+}
+
+void
+clientfree(Client *c)
+{
+	c->next = freeclients;
+	freeclients = c;
+}
+
 void
 clientmessage(const XEvent *e)
 {
@@ -240,7 +564,7 @@ clientmessage(const XEvent *e)
 
 	if (ev->message_type == wmatom[WMProtocols] &&
 	    ev->data.l[0] == wmatom[WMDelete]) {
-		if (nclients > 1 && killclientsfirst) {
+		if (tabs.n > 1 && killclientsfirst) {
 			killclient(0);
 			return;
 		}
@@ -248,20 +572,36 @@ clientmessage(const XEvent *e)
 	}
 }
 
+/* Returns where clients start: a single tab covers the bar. */
+int
+clienty(void)
+{
+	return tabs.n == 1 ? 0 : bh;
+}
+
 void
 configurenotify(const XEvent *e)
 {
 	const XConfigureEvent *ev = &e->xconfigure;
+	int i;
 
 	if (ev->window == win && (ev->width != ww || ev->height != wh)) {
 		ww = ev->width;
 		wh = ev->height;
-		XFreePixmap(dpy, dc.drawable);
-		dc.drawable = XCreatePixmap(dpy, win, ww, wh,
-		              32);
-		if (sel > -1)
-			resize(sel, ww, wh - bh);
-		XSync(dpy, False);
+		/* only grow the bar pixmap, or shrink it to less than half */
+		if (ww > dc.dw || ww < dc.dw / 2) {
+			XFreePixmap(dpy, dc.drawable);
+			dc.dw = ww + ww / 8;
+			dc.drawable = XCreatePixmap(dpy, win, dc.dw, bh, 32);
+			XftDrawChange(dc.xftdraw, dc.drawable);
+			for (i = 0; i < ncells; i++)
+				cells[i].w = 0;
+		}
+		damage(0, ww);
+		redraw = True;
+		/* debounce: the client relayouts once the size settled */
+		timerdue[ResizeTimer] = 0;
+		settimer(ResizeTimer, resizedelay);
 	}
 }
 
@@ -274,13 +614,21 @@ configurerequest(const XEvent *e)
 
 	if ((c = getclient(ev->window)) > -1) {
 		wc.x = 0;
-		wc.y = bh;
+		wc.y = clienty();
 		wc.width = ww;
-		wc.height = wh - bh;
+		wc.height = wh - wc.y;
 		wc.border_width = 0;
 		wc.sibling = ev->above;
 		wc.stack_mode = ev->detail;
 		XConfigureWindow(dpy, clients[c]->win, ev->value_mask, &wc);
+		if (ev->value_mask & CWX)
+			clients[c]->x = wc.x;
+		if (ev->value_mask & CWY)
+			clients[c]->y = wc.y;
+		if (ev->value_mask & CWWidth)
+			clients[c]->w = wc.width;
+		if (ev->value_mask & CWHeight)
+			clients[c]->h = wc.height;
 	}
 }
 
@@ -289,7 +637,8 @@ createnotify(const XEvent *e)
 {
 	const XCreateWindowEvent *ev = &e->xcreatewindow;
 
-	if (ev->window != win && getclient(ev->window) < 0)
+	if (ev->window != win && getclient(ev->window) < 0 &&
+	    getpooled(ev->window) < 0 && getpending(ev->window) < 0)
 		manage(ev->window);
 }
 
@@ -299,8 +648,61 @@ destroynotify(const XEvent *e)
 	const XDestroyWindowEvent *ev = &e->xdestroywindow;
 	int c;
 
-	if ((c = getclient(ev->window)) > -1)
+	if ((c = getclient(ev->window)) > -1) {
 		unmanage(c);
+	} else if ((c = getpooled(ev->window)) > -1) {
+		npool--;
+		memmove(&pool[c], &pool[c + 1], sizeof(*pool) * (npool - c));
+	} else if ((c = getpending(ev->window)) > -1) {
+		pending[c] = pending[--npending];
+	}
+}
+
+void
+damage(int x, int w)
+{
+	if (w <= 0)
+		return;
+	if (dmgx1 <= dmgx0) {
+		dmgx0 = x;
+		dmgx1 = x + w;
+	} else {
+		dmgx0 = MIN(dmgx0, x);
+		dmgx1 = MAX(dmgx1, x + w);
+	}
+}
+
+/* Moves pending window p to the pool if its _NET_WM_PID is that of a
+ * pool client, to the tabs if not.  Without the property this is only
+ * known once it maps.  */
+void
+decide(int p, Bool mapping)
+{
+	Window w = pending[p];
+	pid_t pid = winpid(w);
+	int i;
+
+	if (!pid && npoolpids && !mapping)
+		return;
+	for (i = 0; i < npoolpids && poolpids[i] != pid; i++)
+		;
+
+	pending[p] = pending[--npending];
+	if (pid && i < npoolpids) {
+		/* keep it unmapped until spawn() asks for a tab */
+		poolpids[i] = poolpids[--npoolpids];
+		pool[npool++] = w;
+		pooltied = True;
+		return;
+	}
+	if (!pid && npoolpids && !pooltied) {
+		/* cmd likely does not set _NET_WM_PID, its pool clients would
+		 * only turn up as tabs nobody asked for */
+		while (npoolpids)
+			kill(poolpids[--npoolpids], SIGTERM);
+		pooloff = True;
+	}
+	addtab(w);
 }
 
 void
@@ -311,6 +713,7 @@ die(const char *errstr, ...)
 	va_start(ap, errstr);
 	vfprintf(stderr, errstr, ap);
 	va_end(ap);
+	tracedump();
 	exit(EXIT_FAILURE);
 }
 
@@ -318,51 +721,72 @@ void
 drawbar(void)
 {
 	XftColor *col;
+	TabsView v;
 	int c, cc, fc, width;
 	char *name = NULL;
 	char tabtitle[256];
 
-	if (nclients == 0) {
+	redraw = False;
+	if (tabs.n == 0) {
 		dc.x = 0;
 		dc.w = ww;
 		XFetchName(dpy, win, &name);
-		drawtext(name ? name : "", dc.norm);
+		drawtext(name ? name : "", dc.norm, NULL);
+		XFree(name);
 		XCopyArea(dpy, dc.drawable, win, dc.gc, 0, 0, ww, bh, 0, 0);
-		XSync(dpy, False);
+		XFlush(dpy);
+		for (c = 0; c < ncells; c++)
+			cells[c].w = 0;
+		dmgx0 = dmgx1 = 0;
+		stats.frames++;
+		stats.pixels += stats.lastpixels = (unsigned long)ww * bh;
 
 		return;
 	}
 
-	if (nclients == 1) {
-		XMoveResizeWindow(dpy, clients[0]->win, 0, 0, ww, wh - 0);
+	/* the bar is hidden for a single tab, move clients when that
+	 * changes, size changes are left to resizesel() */
+	if (tabs.n <= 2) {
+		for (c = 0; c < tabs.n; c++) {
+			if (clients[c]->y != clienty())
+				resize(c);
+		}
+	}
+	if (tabs.n == 1)
 		return;
-	} else if (nclients == 2)
-		XMoveResizeWindow(dpy, clients[1]->win, 0, bh, ww, wh - bh);
 
-	width = ww;
-	cc = ww / tabwidth;
-	if (nclients > cc)
-		cc = (ww - TEXTW(before) - TEXTW(after)) / tabwidth;
+	tabsview(&tabs, &v, ww, tabwidth, dc.beforew, dc.afterw);
+	fc = v.fc;
+	cc = v.cc;
+	width = v.w;
+
+	stats.lastpixels = 0;
+	if (ncells < cc + 2) {
+		cells = erealloc(cells, sizeof(*cells) * (cc + 2));
+		memset(&cells[ncells], 0, sizeof(*cells) * (cc + 2 - ncells));
+		ncells = cc + 2;
+	}
 
-	if ((fc = getfirsttab()) + cc < nclients) {
-		dc.w = TEXTW(after);
-		dc.x = width - dc.w;
-		drawtext(after, dc.sel);
-		width -= dc.w;
+	if (v.after) {
+		dc.w = dc.afterw;
+		dc.x = ww - dc.w;
+		drawcell(0, after, dc.sel, &dc.afterext);
+	} else {
+		cells[0].w = 0;
 	}
 	dc.x = 0;
 
-	if (fc > 0) {
-		dc.w = TEXTW(before);
-		drawtext(before, dc.sel);
+	if (v.before) {
+		dc.w = dc.beforew;
+		drawcell(1, before, dc.sel, &dc.beforeext);
 		dc.x += dc.w;
-		width -= dc.w;
+	} else {
+		cells[1].w = 0;
 	}
 
-	cc = MIN(cc, nclients);
 	for (c = fc; c < fc + cc; c++) {
 		dc.w = width / cc;
-		if (c == sel) {
+		if (c == tabs.sel) {
 			col = dc.sel;
 			dc.w += width % cc;
 		} else {
@@ -370,20 +794,59 @@ drawbar(void)
 		}
 		snprintf(tabtitle, sizeof(tabtitle), "%d: %s",
 		         c + 1, clients[c]->name);
-		drawtext(tabtitle, col);
+		if (clients[c]->tabnum != c + 1) {
+			clients[c]->tabnum = c + 1;
+			clients[c]->label.n = 0;
+		}
+		drawcell(c - fc + 2, tabtitle, col, &clients[c]->label);
 		dc.x += dc.w;
-		clients[c]->tabx = dc.x;
 	}
-	XCopyArea(dpy, dc.drawable, win, dc.gc, 0, 0, ww, bh, 0, 0);
-	XSync(dpy, False);
+	for (c = cc + 2; c < ncells; c++)
+		cells[c].w = 0;
+
+	if (dmgx1 > dmgx0)
+		XCopyArea(dpy, dc.drawable, win, dc.gc, dmgx0, 0,
+		          dmgx1 - dmgx0, bh, dmgx0, 0);
+	dmgx0 = dmgx1 = 0;
+	stats.frames++;
+	XFlush(dpy);
+}
+
+/* Draws text into cells[i] at dc.x, unless the pixmap shows it already. */
+void
+drawcell(int i, const char *text, XftColor col[ColLast], Extents *e)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	const char *p;
+	Cell *cell = &cells[i];
+
+	for (p = text; *p; p++)
+		hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+
+	if (cell->w == dc.w && cell->x == dc.x && cell->hash == hash &&
+	    cell->col == col)
+		return;
+
+	cell->x = dc.x;
+	cell->w = dc.w;
+	cell->hash = hash;
+	cell->col = col;
+	if (!pixcopy(hash, col)) {
+		drawtext(text, col, e);
+		pixstore(hash, col);
+	}
+	damage(dc.x, dc.w);
+	stats.lastpixels += (unsigned long)dc.w * bh;
+	stats.pixels += (unsigned long)dc.w * bh;
 }
 
+/* e caches the prefix advances of text, NULL if text is not cached */
 void
-drawtext(const char *text, XftColor col[ColLast])
+drawtext(const char *text, XftColor col[ColLast], Extents *e)
 {
-	int i, j, x, y, h, len, olen;
-	char buf[256];
-	XftDraw *d;
+	int x, y, h, lo, hi, mid, len, avail, trimw;
+	char buf[256 + sizeof(titletrim)];
+	Extents tmp;
 	XRectangle r = { dc.x, dc.y, dc.w, dc.h };
 
 	XSetForeground(dpy, dc.gc, col[ColBG].pixel);
@@ -391,28 +854,135 @@ drawtext(const char *text, XftColor col[ColLast])
 	if (!text)
 		return;
 
-	olen = strlen(text);
+	if (!e) {
+		e = &tmp;
+		e->n = 0;
+	}
+	if (!e->n)
+		getextents(text, e);
+
 	h = dc.font.ascent + dc.font.descent;
 	y = dc.y + (dc.h / 2) - (h / 2) + dc.font.ascent;
 	x = dc.x + (h / 2);
-
-	/* shorten text if necessary */
-	for (len = MIN(olen, sizeof(buf));
-		len && textnw(text, len) > dc.w - h; len--);
+	avail = dc.w - h;
+	hi = e->n - 1;
+	len = e->off[hi];
+
+	/* shorten text if necessary, never splitting a codepoint */
+	if (text[len] || textextent(text, e, hi) > avail) {
+		trimw = dc.trimw <= avail ? dc.trimw : 0;
+		for (lo = 0; lo < hi;) {
+			mid = (lo + hi + 1) / 2;
+			if (textextent(text, e, mid) + trimw <= avail)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		len = e->off[lo];
+		memcpy(buf, text, len);
+		if (trimw) {
+			memcpy(&buf[len], titletrim, strlen(titletrim));
+			len += strlen(titletrim);
+		}
+	} else {
+		memcpy(buf, text, len);
+	}
 
 	if (!len)
 		return;
 
-	memcpy(buf, text, len);
-	if (len < olen) {
-		for (i = len, j = strlen(titletrim); j && i;
-		     buf[--i] = titletrim[--j])
-			;
+	XftDrawStringUtf8(dc.xftdraw, &col[ColFG], dc.font.xfont, x, y,
+	                  (XftChar8 *) buf, len);
+}
+
+void
+dumphist(const char *name, const Hist *h)
+{
+	int i;
+
+	if (!h->n)
+		return;
+	fprintf(stderr, "%s: %-18s %10lu %10llu", argv0, name, h->n,
+	        h->us / h->n);
+	for (i = 0; i < HISTLEN; i++)
+		fprintf(stderr, " %6lu", h->b[i]);
+	fprintf(stderr, "\n");
+}
+
+void
+dumpstats(void)
+{
+	char buf[16];
+	unsigned long lim;
+	int i;
+
+	fprintf(stderr, "%s: %-18s %10s %10s %10s %10s\n", argv0, "event",
+	        "count", "requests", "roundtrips", "bytes");
+	for (i = 0; i < LASTEvent; i++) {
+		if (!stats.evx[i].n && !stats.evx[i].requests)
+			continue;
+		if (evname[i])
+			fprintf(stderr, "%s: %-18s", argv0, evname[i]);
+		else
+			fprintf(stderr, "%s: event %-12d", argv0, i);
+		dumptraffic(&stats.evx[i]);
+	}
+	fprintf(stderr, "%s: %-18s %10s %10s %10s %10s\n", argv0, "action",
+	        "count", "requests", "roundtrips", "bytes");
+	for (i = ActNone + 1; i < ActLast; i++) {
+		fprintf(stderr, "%s: %-18s", argv0, actname[i]);
+		dumptraffic(&stats.actx[i]);
 	}
+	/* latency buckets in us, k is 1024 */
+	fprintf(stderr, "%s: %-18s %10s %10s", argv0, "latency", "count",
+	        "mean us");
+	for (i = 0, lim = 4; i < HISTLEN - 1; i++, lim *= 4) {
+		snprintf(buf, sizeof(buf), lim < 1024 ? "<%lu" : "<%luk",
+		         lim < 1024 ? lim : lim / 1024);
+		fprintf(stderr, " %6s", buf);
+	}
+	fprintf(stderr, " %6s\n", "more");
+	for (i = 0; i < LASTEvent; i++)
+		dumphist(evname[i] ? evname[i] : "other", &stats.evlat[i]);
+	for (i = 0; i < PathLast; i++)
+		dumphist(pathname[i], &stats.pathlat[i]);
+	fprintf(stderr, "%s: %-18s %10lu\n", argv0, "ignored xerrors",
+	        stats.xerrors);
+	fprintf(stderr, "%s: %-18s %10lu\n", argv0, "heap allocations",
+	        stats.allocs);
+	fprintf(stderr, "%s: %-18s %10lu\n", argv0, "coalesced titles",
+	        stats.titlesdropped);
+	fprintf(stderr, "%s: %-18s %10lu\n", argv0, "coalesced events",
+	        stats.evcoalesced);
+	fprintf(stderr, "%s: %-18s %10lu\n", argv0, "skipped configures",
+	        stats.configskipped);
+	fprintf(stderr, "%s: %-18s %10lu\n", argv0, "pool hits",
+	        stats.poolhits);
+	fprintf(stderr, "%s: %-18s %10lu\n", argv0, "pool misses",
+	        stats.poolmisses);
+	fprintf(stderr, "%s: %-18s %10lu\n", argv0, "bar frames",
+	        stats.frames);
+	fprintf(stderr, "%s: %-18s %10lu\n", argv0, "pixels repainted",
+	        stats.pixels);
+	fprintf(stderr, "%s: %-18s %10lu\n", argv0, "last frame pixels",
+	        stats.lastpixels);
+	fprintf(stderr, "%s: %-18s %10lu\n", argv0, "label cache hits",
+	        stats.pixhits);
+	fprintf(stderr, "%s: %-18s %10lu\n", argv0, "label cache misses",
+	        stats.pixmisses);
+	fprintf(stderr, "%s: %-18s %10lu\n", argv0, "label cache bytes",
+	        pixbytes);
+	fprintf(stderr, "%s: %-18s %10lu\n", argv0, "pixmap bytes",
+	        (unsigned long)dc.dw * bh * 4);
+	fprintf(stderr, "%s: %-18s %10lu\n", argv0, "x requests",
+	        NextRequest(dpy) - 1);
+}
 
-	d = XftDrawCreate(dpy, dc.drawable, visual, cmap);
-	XftDrawStringUtf8(d, &col[ColFG], dc.font.xfont, x, y, (XftChar8 *) buf, len);
-	XftDrawDestroy(d);
+void
+dumptraffic(const Traffic *t)
+{
+	fprintf(stderr, " %10lu %10lu %10lu %10lu\n", t->n, t->requests,
+	        t->roundtrips, t->bytes);
 }
 
 void *
@@ -440,8 +1010,10 @@ expose(const XEvent *e)
 {
 	const XExposeEvent *ev = &e->xexpose;
 
-	if (ev->count == 0 && win == ev->window)
-		drawbar();
+	if (win == ev->window && ev->y < bh) {
+		damage(ev->x, ev->width);
+		redraw = True;
+	}
 }
 
 void
@@ -449,10 +1021,11 @@ focus(int c)
 {
 	char buf[BUFSIZ] = "tabbed-"VERSION" ::";
 	size_t i, n;
-	XWMHints* wmh;
+	long long t, t0;
+	int prev;
 
 	/* If c, sel and clients are -1, raise tabbed-win itself */
-	if (nclients == 0) {
+	if (tabs.n == 0) {
 		cmd[cmd_append_pos] = NULL;
 		for(i = 0, n = strlen(buf); cmd[i] && n < sizeof(buf); i++)
 			n += snprintf(&buf[n], sizeof(buf) - n, " %s", cmd[i]);
@@ -463,30 +1036,41 @@ focus(int c)
 		return;
 	}
 
-	if (c < 0 || c >= nclients)
+	if (c < 0 || c >= tabs.n)
 		return;
 
-	resize(c, ww, wh - bh);
+	prev = actstart(ActSwitch);
+	t0 = timeus();
+	resize(c);
+	histadd(&stats.pathlat[PathResize], (t = timeus()) - t0);
 	XRaiseWindow(dpy, clients[c]->win);
 	XSetInputFocus(dpy, clients[c]->win, RevertToParent, CurrentTime);
 	sendxembed(c, XEMBED_FOCUS_IN, XEMBED_FOCUS_CURRENT, 0, 0);
 	sendxembed(c, XEMBED_WINDOW_ACTIVATE, 0, 0, 0);
+	histadd(&stats.pathlat[PathXEmbed], timeus() - t);
 	xsettitle(win, clients[c]->name);
 
-	if (sel != c) {
-		lastsel = sel;
-		sel = c;
+	if (tabs.sel != c) {
+		tabsselect(&tabs, c);
+		/* a switch lasts from its event until the bar shows it */
+		if (!switchstart)
+			switchstart = evstart ? evstart : t0;
+		/* its deferred title is now due at the shorter interval */
+		if (clients[c]->titlepending)
+			settimer(TitleTimer, clients[c]->titlet +
+			         seltitleinterval - timems());
 	}
+	clients[c]->used = ++focusclock;
+	histadd(&stats.pathlat[PathFocus], timeus() - t0);
 
-	if (clients[c]->urgent && (wmh = XGetWMHints(dpy, clients[c]->win))) {
-		wmh->flags &= ~XUrgencyHint;
-		XSetWMHints(dpy, clients[c]->win, wmh);
+	if (clients[c]->urgent) {
+		clients[c]->hints.flags &= ~XUrgencyHint;
+		XSetWMHints(dpy, clients[c]->win, &clients[c]->hints);
 		clients[c]->urgent = False;
-		XFree(wmh);
 	}
 
-	drawbar();
-	XSync(dpy, False);
+	redraw = True;
+	curact = prev;
 }
 
 void
@@ -499,7 +1083,7 @@ focusin(const XEvent *e)
 	if (ev->mode != NotifyUngrab) {
 		XGetInputFocus(dpy, &focused, &dummy);
 		if (focused == win)
-			focus(sel);
+			focus(tabs.sel);
 	}
 }
 
@@ -514,10 +1098,10 @@ focusurgent(const Arg *arg)
 {
 	int c;
 
-	if (sel < 0)
+	if (tabs.sel < 0)
 		return;
 
-	for (c = (sel + 1) % nclients; c != sel; c = (c + 1) % nclients) {
+	for (c = (tabs.sel + 1) % tabs.n; c != tabs.sel; c = (c + 1) % tabs.n) {
 		if (clients[c]->urgent) {
 			focus(c);
 			return;
@@ -525,6 +1109,25 @@ focusurgent(const Arg *arg)
 	}
 }
 
+pid_t
+forkcmd(char **argv)
+{
+	pid_t pid;
+
+	if ((pid = fork()) == 0) {
+		if(dpy)
+			close(ConnectionNumber(dpy));
+
+		setsid();
+		execvp(argv[0], argv);
+		fprintf(stderr, "%s: execvp %s", argv0, argv[0]);
+		perror(" failed");
+		exit(0);
+	}
+
+	return pid;
+}
+
 void
 fullscreen(const Arg *arg)
 {
@@ -563,14 +1166,13 @@ getatom(int a)
 int
 getclient(Window w)
 {
-	int i;
+	Slot *s;
 
-	for (i = 0; i < nclients; i++) {
-		if (clients[i]->win == w)
-			return i;
-	}
+	if (w == None || !nwinindex)
+		return -1;
 
-	return -1;
+	s = indexslot(w);
+	return s->win ? s->c : -1;
 }
 
 XftColor
@@ -584,55 +1186,190 @@ getcolor(const char *colstr)
 	return color;
 }
 
+/* Record the UTF-8 codepoint boundaries of the first 255 bytes of text,
+ * their advances are measured lazily by textextent().  */
+void
+getextents(const char *text, Extents *e)
+{
+	int i;
+
+	e->n = 0;
+	for (i = 0; i < LENGTH(e->off); i++) {
+		if ((text[i] & 0xc0) != 0x80) {
+			e->off[e->n] = i;
+			e->w[e->n++] = i ? -1 : 0;
+		}
+		if (!text[i])
+			break;
+	}
+}
+
 int
-getfirsttab(void)
+getpending(Window w)
 {
-	int cc, ret;
+	int i;
 
-	if (sel < 0)
-		return 0;
+	for (i = 0; i < npending; i++) {
+		if (pending[i] == w)
+			return i;
+	}
+
+	return -1;
+}
 
-	cc = ww / tabwidth;
-	if (nclients > cc)
-		cc = (ww - TEXTW(before) - TEXTW(after)) / tabwidth;
+int
+getpooled(Window w)
+{
+	int i;
+
+	for (i = 0; i < npool; i++) {
+		if (pool[i] == w)
+			return i;
+	}
 
-	ret = sel - cc / 2 + (cc + 1) % 2;
-	return ret < 0 ? 0 :
-	       ret + cc > nclients ? MAX(0, nclients - cc) :
-	       ret;
+	return -1;
 }
 
 Bool
 gettextprop(Window w, Atom atom, char *text, unsigned int size)
 {
 	char **list = NULL;
-	int n;
+	int n, format;
+	unsigned long len, nitems, after;
+	unsigned char *p = NULL;
+	Atom type;
 	XTextProperty name;
 
 	if (!text || size == 0)
 		return False;
 
 	text[0] = '\0';
-	XGetTextProperty(dpy, w, &name, atom);
-	if (!name.nitems)
+
+	/* fast path: UTF8_STRING and STRING are copied without conversion */
+	if (XGetWindowProperty(dpy, w, atom, 0L, size / 4, False,
+	                       AnyPropertyType, &type, &format, &nitems, &after,
+	                       &p) != Success || type == None || !nitems) {
+		XFree(p);
 		return False;
+	}
+	if (format == 8 && (type == wmatom[Utf8String] || type == XA_STRING)) {
+		nitems = MIN(nitems, size - 1);
+		len = type == XA_STRING ? nitems : utf8len(p, nitems);
+		/* a sequence cut short by size is dropped, bad input is not */
+		if (len == nitems || (nitems == size - 1 && len + 3 >= nitems)) {
+			memcpy(text, p, len);
+			text[len] = '\0';
+			XFree(p);
+			return True;
+		}
+	}
 
-	if (name.encoding == XA_STRING) {
-		strncpy(text, (char *)name.value, size - 1);
+	/* anything else is converted from the same reply */
+	name.value = p;
+	name.encoding = type;
+	name.format = format;
+	name.nitems = nitems;
+	if (type == XA_STRING) {
+		strncpy(text, (char *)p, size - 1);
 	} else if (XmbTextPropertyToTextList(dpy, &name, &list, &n) >= Success
 	           && n > 0 && *list) {
 		strncpy(text, *list, size - 1);
 		XFreeStringList(list);
 	}
 	text[size - 1] = '\0';
-	XFree(name.value);
+	XFree(p);
 
 	return True;
 }
 
+void
+histadd(Hist *h, long long us)
+{
+	int i;
+
+	h->n++;
+	h->us += us;
+	for (i = 0; i < HISTLEN - 1 && us >= 4; i++)
+		us >>= 2;
+	h->b[i]++;
+}
+
+void
+indexdel(Window w)
+{
+	Slot *s;
+	int i, j, k, mask = nslots - 1;
+
+	if (w == None || !nwinindex || !(s = indexslot(w))->win)
+		return;
+
+	/* backward shift deletion, keeps probe chains intact */
+	i = j = s - winindex;
+	for (;;) {
+		winindex[i].win = None;
+		do {
+			j = (j + 1) & mask;
+			if (!winindex[j].win) {
+				nwinindex--;
+				return;
+			}
+			k = WINHASH(winindex[j].win) & mask;
+		} while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+		winindex[i] = winindex[j];
+		i = j;
+	}
+}
+
+void
+indexset(Window w, int c)
+{
+	Slot *s, *old;
+	int i, n;
+
+	if (w == None)
+		return;
+
+	/* keep the load factor below one half */
+	if ((nwinindex + 1) * 2 > nslots) {
+		old = winindex;
+		n = nslots;
+		nslots = MAX(64, nslots * 2);
+		winindex = ecalloc(nslots, sizeof(*winindex));
+		stats.allocs++;
+		for (i = 0; i < n; i++) {
+			if (old[i].win)
+				*indexslot(old[i].win) = old[i];
+		}
+		free(old);
+	}
+
+	if (!(s = indexslot(w))->win) {
+		s->win = w;
+		nwinindex++;
+	}
+	s->c = c;
+}
+
+/* Returns the slot holding w, or the free slot where it would go. */
+Slot *
+indexslot(Window w)
+{
+	int i, mask = nslots - 1;
+
+	for (i = WINHASH(w) & mask; winindex[i].win;
+	     i = (i + 1) & mask) {
+		if (winindex[i].win == w)
+			break;
+	}
+
+	return &winindex[i];
+}
+
 void
 initfont(const char *fontstr)
 {
+	int i;
+
 	if (!(dc.font.xfont = XftFontOpenName(dpy, screen, fontstr))
 	    && !(dc.font.xfont = XftFontOpenName(dpy, screen, "fixed")))
 		die("error, cannot load font: '%s'\n", fontstr);
@@ -640,16 +1377,24 @@ initfont(const char *fontstr)
 	dc.font.ascent = dc.font.xfont->ascent;
 	dc.font.descent = dc.font.xfont->descent;
 	dc.font.height = dc.font.ascent + dc.font.descent;
+
+	/* a new font invalidates every cached text width */
+	dc.beforew = TEXTW(before);
+	dc.afterw = TEXTW(after);
+	dc.trimw = textnw(titletrim, strlen(titletrim));
+	dc.beforeext.n = dc.afterext.n = 0;
+	for (i = 0; i < tabs.n; i++)
+		clients[i]->tabnum = 0;
 }
 
 Bool
-isprotodel(int c)
+isprotodel(Window w)
 {
 	int i, n;
 	Atom *protocols;
 	Bool ret = False;
 
-	if (XGetWMProtocols(dpy, clients[c]->win, &protocols, &n)) {
+	if (XGetWMProtocols(dpy, w, &protocols, &n)) {
 		for (i = 0; !ret && i < n; i++) {
 			if (protocols[i] == wmatom[WMDelete])
 				ret = True;
@@ -665,14 +1410,12 @@ keypress(const XEvent *e)
 {
 	const XKeyEvent *ev = &e->xkey;
 	unsigned int i;
-	KeySym keysym;
+	const Key *k;
 
-	keysym = XkbKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0, 0);
-	for (i = 0; i < LENGTH(keys); i++) {
-		if (keysym == keys[i].keysym &&
-		    CLEANMASK(keys[i].mod) == CLEANMASK(ev->state) &&
-		    keys[i].func)
-			keys[i].func(&(keys[i].arg));
+	for (i = keyhead[ev->keycode & 0xff]; i; i = keynext[i - 1]) {
+		k = &keys[i - 1];
+		if (CLEANMASK(k->mod) == CLEANMASK(ev->state) && k->func)
+			k->func(&(k->arg));
 	}
 }
 
@@ -681,146 +1424,292 @@ killclient(const Arg *arg)
 {
 	XEvent ev;
 
-	if (sel < 0)
+	if (tabs.sel < 0)
 		return;
 
-	if (isprotodel(sel) && !clients[sel]->closed) {
+	if (clients[tabs.sel]->candelete < 0)
+		clients[tabs.sel]->candelete = isprotodel(clients[tabs.sel]->win);
+	if (clients[tabs.sel]->candelete && !clients[tabs.sel]->closed) {
 		ev.type = ClientMessage;
-		ev.xclient.window = clients[sel]->win;
+		ev.xclient.window = clients[tabs.sel]->win;
 		ev.xclient.message_type = wmatom[WMProtocols];
 		ev.xclient.format = 32;
 		ev.xclient.data.l[0] = wmatom[WMDelete];
 		ev.xclient.data.l[1] = CurrentTime;
-		XSendEvent(dpy, clients[sel]->win, False, NoEventMask, &ev);
-		clients[sel]->closed = True;
+		XSendEvent(dpy, clients[tabs.sel]->win, False, NoEventMask,
+		           &ev);
+		clients[tabs.sel]->closed = True;
 	} else {
-		XKillClient(dpy, clients[sel]->win);
+		XKillClient(dpy, clients[tabs.sel]->win);
 	}
 }
 
+/* Embeds w.  Nothing up to addtab() waits for a reply, adopting a client
+ * still costs 2-4 round trips: WM_HINTS, _NET_WM_NAME, WM_NAME if that is
+ * not set and _NET_WM_PID while pool clients are starting.  */
 void
 manage(Window w)
 {
-	updatenumlockmask();
-	{
-		int i, j, nextpos;
-		unsigned int modifiers[] = { 0, LockMask, numlockmask,
-		                             numlockmask | LockMask };
-		KeyCode code;
-		Client *c;
-		XEvent e;
-
-		XWithdrawWindow(dpy, w, 0);
-		XReparentWindow(dpy, w, win, 0, bh);
-		XSelectInput(dpy, w, PropertyChangeMask |
-		             StructureNotifyMask | EnterWindowMask);
-		XSync(dpy, False);
-
-		for (i = 0; i < LENGTH(keys); i++) {
-			if ((code = XKeysymToKeycode(dpy, keys[i].keysym))) {
-				for (j = 0; j < LENGTH(modifiers); j++) {
-					XGrabKey(dpy, code, keys[i].mod |
-					         modifiers[j], w, True,
-					         GrabModeAsync, GrabModeAsync);
-				}
-			}
-		}
-
-		c = ecalloc(1, sizeof *c);
-		c->win = w;
-
-		nclients++;
-		clients = erealloc(clients, sizeof(Client *) * nclients);
-
-		if(npisrelative) {
-			nextpos = sel + newposition;
-		} else {
-			if (newposition < 0)
-				nextpos = nclients - newposition;
-			else
-				nextpos = newposition;
-		}
-		if (nextpos >= nclients)
-			nextpos = nclients - 1;
-		if (nextpos < 0)
-			nextpos = 0;
-
-		if (nclients > 1 && nextpos < nclients - 1)
-			memmove(&clients[nextpos + 1], &clients[nextpos],
-			        sizeof(Client *) * (nclients - nextpos - 1));
+	XEvent e;
 
-		clients[nextpos] = c;
-		updatetitle(nextpos);
+	XWithdrawWindow(dpy, w, 0);
+	XReparentWindow(dpy, w, win, 0, bh);
+	XSelectInput(dpy, w, PropertyChangeMask |
+	             StructureNotifyMask | EnterWindowMask);
 
-		XLowerWindow(dpy, w);
-		XMapWindow(dpy, w);
+	e.xclient.window = w;
+	e.xclient.type = ClientMessage;
+	e.xclient.message_type = wmatom[XEmbed];
+	e.xclient.format = 32;
+	e.xclient.data.l[0] = CurrentTime;
+	e.xclient.data.l[1] = XEMBED_EMBEDDED_NOTIFY;
+	e.xclient.data.l[2] = 0;
+	e.xclient.data.l[3] = win;
+	e.xclient.data.l[4] = 0;
+	XSendEvent(dpy, root, False, NoEventMask, &e);
 
-		e.xclient.window = w;
-		e.xclient.type = ClientMessage;
-		e.xclient.message_type = wmatom[XEmbed];
-		e.xclient.format = 32;
-		e.xclient.data.l[0] = CurrentTime;
-		e.xclient.data.l[1] = XEMBED_EMBEDDED_NOTIFY;
-		e.xclient.data.l[2] = 0;
-		e.xclient.data.l[3] = win;
-		e.xclient.data.l[4] = 0;
-		XSendEvent(dpy, root, False, NoEventMask, &e);
+	/* only tell pool clients apart while some are starting */
+	if (!npoolpids) {
+		addtab(w);
+		return;
+	}
+	if (npending == npendingcap) {
+		npendingcap = npendingcap ? npendingcap * 2 : 8;
+		pending = erealloc(pending, sizeof(*pending) * npendingcap);
+	}
+	pending[npending++] = w;
+	decide(npending - 1, False);
+}
 
-		XSync(dpy, False);
+void
+mappingnotify(const XEvent *e)
+{
+	XMappingEvent *ev = (XMappingEvent *)&e->xmapping;
 
-		/* Adjust sel before focus does set it to lastsel. */
-		if (sel >= nextpos)
-			sel++;
-		focus(nextfocus ? nextpos :
-		      sel < 0 ? 0 :
-		      sel);
-		nextfocus = foreground;
-	}
+	XRefreshKeyboardMapping(ev);
+	if (ev->request == MappingKeyboard || ev->request == MappingModifier)
+		updatekeys();
 }
 
 void
 maprequest(const XEvent *e)
 {
 	const XMapRequestEvent *ev = &e->xmaprequest;
+	int p;
 
-	if (getclient(ev->window) < 0)
+	if (getclient(ev->window) < 0 && getpooled(ev->window) < 0 &&
+	    getpending(ev->window) < 0)
 		manage(ev->window);
+	if ((p = getpending(ev->window)) > -1)
+		decide(p, True);
 }
 
 void
 move(const Arg *arg)
 {
-	if (arg->i >= 0 && arg->i < nclients)
+	if (arg->i >= 0 && arg->i < tabs.n)
 		focus(arg->i);
 }
 
 void
 movetab(const Arg *arg)
 {
-	int c;
-	Client *new;
+	int c, from = tabs.sel;
 
-	if (sel < 0)
+	if (tabs.sel < 0)
 		return;
 
-	c = (sel + arg->i) % nclients;
-	if (c < 0)
-		c += nclients;
+	c = tabsrotate(&tabs, tabs.sel, arg->i);
+	if (c == tabs.sel)
+		return;
+
+	tabsmove(&tabs, from, c);
+	reindex(MIN(from, c), MAX(from, c) + 1);
+
+	redraw = True;
+}
 
-	if (c == sel)
+/* Reads every queued event, then handles input first, structural changes
+ * next and property, expose and configure events last.  Property and
+ * ConfigureNotify events are coalesced: only the newest one per window
+ * (and atom) is handled.  */
+void
+processevents(void)
+{
+	static const int order[] = { EvInput, EvStruct, EvLow };
+	XEvent ev, *q;
+	long long t;
+	int i, j, k;
+
+	while (XPending(dpy)) {
+		XNextEvent(dpy, &ev);
+		stats.evx[ev.type].n++;
+		if (!handler[ev.type])
+			continue;
+		/* in the order they arrived, coalesced ones included */
+		if (trace)
+			traceadd(&ev, timeus());
+
+		k = evclass[ev.type];
+		q = evq[k];
+		for (j = k == EvLow ? nevq[k] - 1 : -1; j >= 0; j--) {
+			if (q[j].type == ev.type && ev.type != ConfigureRequest &&
+			    ev.type != Expose &&
+			    q[j].xany.window == ev.xany.window &&
+			    /* xany.window is the parent for ConfigureNotify */
+			    (ev.type != ConfigureNotify ||
+			     q[j].xconfigure.window == ev.xconfigure.window) &&
+			    (ev.type != PropertyNotify ||
+			     (q[j].xproperty.atom == ev.xproperty.atom &&
+			      ev.xproperty.atom != wmatom[WMSelectTab])))
+				break;
+		}
+		if (j >= 0) {
+			q[j] = ev;
+			if (trace)
+				evqtrace[k][j] = ntrace - 1;
+			stats.evcoalesced++;
+			continue;
+		}
+
+		if (nevq[k] == evqcap[k]) {
+			evqcap[k] = MAX(64, evqcap[k] * 2);
+			evq[k] = erealloc(evq[k], evqcap[k] * sizeof(XEvent));
+			if (trace)
+				evqtrace[k] = erealloc(evqtrace[k], evqcap[k] *
+				                       sizeof(*evqtrace[k]));
+		}
+		if (trace)
+			evqtrace[k][nevq[k]] = ntrace - 1;
+		evq[k][nevq[k]++] = ev;
+	}
+
+	/* input pauses background work */
+	if (nevq[EvInput] && timerdue[BgResizeTimer]) {
+		timerdue[BgResizeTimer] = 0;
+		settimer(BgResizeTimer, bgresizedelay);
+	}
+
+	for (i = 0; i < LENGTH(order); i++) {
+		k = order[i];
+		for (j = 0; j < nevq[k] && running; j++) {
+			curev = evq[k][j].type;
+			evstart = timeus();
+			(handler[curev])(&evq[k][j]); /* call handler */
+			t = timeus() - evstart;
+			histadd(&stats.evlat[curev], t);
+			if (trace)
+				tracedone(evqtrace[k][j], t);
+			curev = 0;
+			evstart = 0;
+		}
+		nevq[k] = 0;
+	}
+}
+
+/* Copies the cached rendering of the label with the given hash to dc.x,
+ * if there is one of width dc.w in scheme col.  */
+Bool
+pixcopy(unsigned long long hash, XftColor col[ColLast])
+{
+	int i;
+
+	if (!pixcap)
+		return False;
+	for (i = pixhead[hash & (2 * pixcap - 1)]; i >= 0; i = pixes[i].next) {
+		if (pixes[i].hash == hash && pixes[i].w == dc.w &&
+		    pixes[i].col == col) {
+			XCopyArea(dpy, pixes[i].pm, dc.drawable, dc.gc, 0, 0,
+			          dc.w, bh, dc.x, 0);
+			pixes[i].used = ++pixclock;
+			stats.pixhits++;
+			return True;
+		}
+	}
+
+	return False;
+}
+
+/* Rebuilds the hash buckets of pixes. */
+void
+pixindex(void)
+{
+	int i, b;
+
+	for (i = 0; i < 2 * pixcap; i++)
+		pixhead[i] = -1;
+	for (i = 0; i < npixes; i++) {
+		b = pixes[i].hash & (2 * pixcap - 1);
+		pixes[i].next = pixhead[b];
+		pixhead[b] = i;
+	}
+}
+
+/* Keeps a copy of the label just drawn at dc.x, evicting the least
+ * recently used ones to stay within labelcachesize.  */
+void
+pixstore(unsigned long long hash, XftColor col[ColLast])
+{
+	int i, b, lru, n = npixes;
+	unsigned long size = (unsigned long)dc.w * bh * 4;
+
+	stats.pixmisses++;
+	if (dc.w <= 0 || size > labelcachesize)
 		return;
 
-	new = clients[sel];
-	if (sel < c)
-		memmove(&clients[sel], &clients[sel+1],
-		        sizeof(Client *) * (c - sel));
-	else
-		memmove(&clients[c+1], &clients[c],
-		        sizeof(Client *) * (sel - c));
-	clients[c] = new;
-	sel = c;
+	while (npixes && pixbytes + size > labelcachesize) {
+		for (lru = 0, i = 1; i < npixes; i++) {
+			if (pixes[i].used < pixes[lru].used)
+				lru = i;
+		}
+		XFreePixmap(dpy, pixes[lru].pm);
+		pixbytes -= (unsigned long)pixes[lru].w * bh * 4;
+		pixes[lru] = pixes[--npixes];
+	}
 
-	drawbar();
+	if (npixes == pixcap) {
+		pixcap = pixcap ? pixcap * 2 : 16;
+		pixes = erealloc(pixes, sizeof(*pixes) * pixcap);
+		pixhead = erealloc(pixhead, sizeof(*pixhead) * 2 * pixcap);
+		pixindex();
+	} else if (npixes != n) {
+		/* evicting moved entries around */
+		pixindex();
+	}
+	b = hash & (2 * pixcap - 1);
+	pixes[npixes].next = pixhead[b];
+	pixhead[b] = npixes;
+	pixes[npixes].hash = hash;
+	pixes[npixes].w = dc.w;
+	pixes[npixes].col = col;
+	pixes[npixes].used = ++pixclock;
+	pixes[npixes].pm = XCreatePixmap(dpy, win, dc.w, bh, 32);
+	XCopyArea(dpy, dc.drawable, pixes[npixes].pm, dc.gc, dc.x, 0, dc.w, bh,
+	          0, 0);
+	pixbytes += size;
+	npixes++;
+}
+
+/* Returns whether client c has the geometry of the layout. */
+Bool
+placed(int c)
+{
+	Client *cl = clients[c];
+
+	return cl->x == 0 && cl->y == clienty() && cl->w == ww &&
+	       cl->h == wh - cl->y;
+}
+
+/* Spawns cmd until the pool, counting the clients still starting, is
+ * full.  */
+void
+poolfill(void)
+{
+	pid_t pid;
+
+	cmd[cmd_append_pos] = NULL;
+	while (npool + npoolpids < poolsize && !pooloff && (pid = forkcmd(cmd)) > 0)
+		poolpids[npoolpids++] = pid;
 }
 
 void
@@ -842,51 +1731,79 @@ propertynotify(const XEvent *e)
 			arg.v = cmd;
 			spawn(&arg);
 		}
+	} else if (ev->state == PropertyNewValue && ev->atom == XA_WM_HINTS &&
+	           ev->window == win && (wmh = XGetWMHints(dpy, win))) {
+		/* the window manager clears our urgency hint */
+		winhints = *wmh;
+		XFree(wmh);
 	} else if (ev->state == PropertyNewValue && ev->atom == XA_WM_HINTS &&
 	           (c = getclient(ev->window)) > -1 &&
 	           (wmh = XGetWMHints(dpy, clients[c]->win))) {
-		if (wmh->flags & XUrgencyHint) {
-			XFree(wmh);
-			wmh = XGetWMHints(dpy, win);
-			if (c != sel) {
-				if (urgentswitch && wmh &&
-				    !(wmh->flags & XUrgencyHint)) {
+		clients[c]->hints = *wmh;
+		XFree(wmh);
+		if (clients[c]->hints.flags & XUrgencyHint) {
+			if (c != tabs.sel) {
+				if (urgentswitch &&
+				    !(winhints.flags & XUrgencyHint)) {
 					/* only switch, if tabbed was focused
-					 * since last urgency hint if WMHints
-					 * could not be received,
-					 * default to no switch */
+					 * since last urgency hint */
 					focus(c);
 				} else {
 					/* if no switch should be performed,
 					 * mark tab as urgent */
 					clients[c]->urgent = True;
-					drawbar();
+					redraw = True;
 				}
 			}
-			if (wmh && !(wmh->flags & XUrgencyHint)) {
+			if (!(winhints.flags & XUrgencyHint)) {
 				/* update tabbed urgency hint
 				 * if not set already */
-				wmh->flags |= XUrgencyHint;
-				XSetWMHints(dpy, win, wmh);
+				winhints.flags |= XUrgencyHint;
+				XSetWMHints(dpy, win, &winhints);
 			}
 		}
-		XFree(wmh);
+	} else if (ev->state == PropertyNewValue &&
+	           ev->atom == wmatom[WMProtocols] &&
+	           (c = getclient(ev->window)) > -1) {
+		clients[c]->candelete = -1;
 	} else if (ev->state != PropertyDelete && ev->atom == XA_WM_NAME &&
 	           (c = getclient(ev->window)) > -1) {
-		updatetitle(c);
+		titlechanged(c);
+	} else if (ev->state == PropertyNewValue && ev->atom == wmatom[WMPid] &&
+	           (c = getpending(ev->window)) > -1) {
+		decide(c, False);
 	}
 }
 
+/* Update the window index for clients[from] up to clients[to - 1]. */
 void
-resize(int c, int w, int h)
+reindex(int from, int to)
+{
+	for (; from < to; from++)
+		indexset(clients[from]->win, from);
+}
+
+/* Gives client c the geometry of the layout, unless it has it already. */
+void
+resize(int c)
 {
 	XConfigureEvent ce;
-	XWindowChanges wc;
+	Client *cl = clients[c];
 
-	ce.x = 0;
-	ce.y = bh;
-	ce.width = wc.width = w;
-	ce.height = wc.height = h;
+	/* clients relayout on every ConfigureNotify, spare them */
+	if (placed(c)) {
+		stats.configskipped++;
+		return;
+	}
+	cl->x = 0;
+	cl->y = clienty();
+	cl->w = ww;
+	cl->h = wh - cl->y;
+
+	ce.x = cl->x;
+	ce.y = cl->y;
+	ce.width = cl->w;
+	ce.height = cl->h;
 	ce.type = ConfigureNotify;
 	ce.display = dpy;
 	ce.event = clients[c]->win;
@@ -895,48 +1812,99 @@ resize(int c, int w, int h)
 	ce.override_redirect = False;
 	ce.border_width = 0;
 
-	XConfigureWindow(dpy, clients[c]->win, CWWidth | CWHeight, &wc);
-	XSendEvent(dpy, clients[c]->win, False, StructureNotifyMask,
-	           (XEvent *)&ce);
+	XMoveResizeWindow(dpy, cl->win, cl->x, cl->y, cl->w, cl->h);
+	XSendEvent(dpy, cl->win, False, StructureNotifyMask, (XEvent *)&ce);
 }
 
+/* Resizes the most recently used hidden client which does not have the
+ * current size yet, one per call while tabbed is idle.  */
 void
-rotate(const Arg *arg)
+resizehidden(void)
 {
-	int nsel = -1;
+	int c, best = -1;
 
-	if (sel < 0)
+	for (c = 0; c < tabs.n; c++) {
+		if (c != tabs.sel && !placed(c) &&
+		    (best < 0 || clients[c]->used > clients[best]->used))
+			best = c;
+	}
+	if (best < 0)
+		return;
+
+	resize(best);
+	settimer(BgResizeTimer, bgresizedelay);
+}
+
+void
+resizesel(void)
+{
+	if (tabs.sel > -1)
+		resize(tabs.sel);
+	if (bgresize)
+		settimer(BgResizeTimer, bgresizedelay);
+}
+
+void
+rotate(const Arg *arg)
+{
+	if (tabs.sel < 0)
 		return;
 
 	if (arg->i == 0) {
-		if (lastsel > -1)
-			focus(lastsel);
-	} else if (sel > -1) {
+		if (tabs.lastsel > -1)
+			focus(tabs.lastsel);
+	} else {
 		/* Rotating in an arg->i step around the clients. */
-		nsel = sel + arg->i;
-		while (nsel >= nclients)
-			nsel -= nclients;
-		while (nsel < 0)
-			nsel += nclients;
-		focus(nsel);
+		focus(tabsrotate(&tabs, tabs.sel, arg->i));
 	}
 }
 
 void
 run(void)
 {
-	XEvent ev;
+	struct pollfd pfd[FdLast];
+	long long t, now;
+	int timeout;
 
 	/* main event loop */
 	XSync(dpy, False);
 	drawbar();
 	if (doinitspawn == True)
 		spawn(NULL);
+	else if (poolsize > 0 && cmd[0])
+		poolfill();
 
+	pfd[XFd].fd = ConnectionNumber(dpy);
+	pfd[SignalFd].fd = sigpipe[0];
+	pfd[XFd].events = pfd[SignalFd].events = POLLIN;
 	while (running) {
-		XNextEvent(dpy, &ev);
-		if (handler[ev.type])
-			(handler[ev.type])(&ev); /* call handler */
+		processevents();
+		if (!running)
+			break;
+
+		timeout = timersrun();
+		/* repaint once the queued batch of events is drained */
+		if (redraw) {
+			t = timeus();
+			drawbar();
+			histadd(&stats.pathlat[PathDraw], (now = timeus()) - t);
+			if (switchstart) {
+				histadd(&stats.pathlat[PathSwitch],
+				        now - switchstart);
+				switchstart = 0;
+			}
+		}
+
+		/* timers queue requests too, send them before sleeping */
+		XFlush(dpy);
+
+		/* sleep until the X server, a signal or a timer wakes us */
+		if (XQLength(dpy))
+			timeout = 0;
+		if (poll(pfd, LENGTH(pfd), timeout) < 0 && errno != EINTR)
+			die("%s: poll: %s\n", argv0, strerror(errno));
+		if (pfd[SignalFd].revents & POLLIN)
+			signals();
 	}
 }
 
@@ -979,9 +1947,38 @@ setup(void)
 	XWMHints *wmh;
 	XClassHint class_hint;
 	XSizeHints *size_hint;
+	struct sigaction sa;
+
+	/* signals are handled from the event loop */
+	if (pipe(sigpipe) < 0)
+		die("%s: cannot create signal pipe\n", argv0);
+	fcntl(sigpipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(sigpipe[1], F_SETFD, FD_CLOEXEC);
+	fcntl(sigpipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(sigpipe[1], F_SETFL, O_NONBLOCK);
+	sa.sa_handler = sighandler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGCHLD, &sa, NULL) < 0 ||
+	    sigaction(SIGUSR1, &sa, NULL) < 0 ||
+	    sigaction(SIGUSR2, &sa, NULL) < 0)
+		die("%s: cannot install signal handlers\n", argv0);
+
+	/* the flight recorder is written out when tabbed crashes */
+	if (tracesize) {
+		trace = ecalloc(tracesize, sizeof(*trace));
+		tracelen = tracesize;
+		sa.sa_handler = sigcrash;
+		sa.sa_flags = SA_RESETHAND;
+		sigaction(SIGABRT, &sa, NULL);
+		sigaction(SIGBUS, &sa, NULL);
+		sigaction(SIGFPE, &sa, NULL);
+		sigaction(SIGILL, &sa, NULL);
+		sigaction(SIGSEGV, &sa, NULL);
+	}
 
 	/* clean up any zombies immediately */
-	sigchld(0);
+	while (0 < waitpid(-1, NULL, WNOHANG));
 
 	/* init screen */
 	screen = DefaultScreen(dpy);
@@ -998,6 +1995,8 @@ setup(void)
 	wmatom[WMSelectTab] = XInternAtom(dpy, "_TABBED_SELECT_TAB", False);
 	wmatom[WMState] = XInternAtom(dpy, "_NET_WM_STATE", False);
 	wmatom[XEmbed] = XInternAtom(dpy, "_XEMBED", False);
+	wmatom[Utf8String] = XInternAtom(dpy, "UTF8_STRING", False);
+	wmatom[WMPid] = XInternAtom(dpy, "_NET_WM_PID", False);
 
 	/* init appearance */
 	wx = 0;
@@ -1083,9 +2082,10 @@ setup(void)
 	visual, CWBackPixmap | CWBorderPixel | CWBitGravity
 	| CWEventMask | CWColormap, &attrs);
 
-	dc.drawable = XCreatePixmap(dpy, win, ww, wh,
-	                            32);
+	dc.dw = ww;
+	dc.drawable = XCreatePixmap(dpy, win, dc.dw, bh, 32);
 	dc.gc = XCreateGC(dpy, dc.drawable, 0, 0);
+	dc.xftdraw = XftDrawCreate(dpy, dc.drawable, visual, cmap);
 
 	XMapRaised(dpy, win);
 	XSelectInput(dpy, win, SubstructureNotifyMask | FocusChangeMask |
@@ -1093,6 +2093,9 @@ setup(void)
 	             PropertyChangeMask | StructureNotifyMask |
 	             SubstructureRedirectMask);
 	xerrorxlib = XSetErrorHandler(xerror);
+	updatekeys();
+	XSetAfterFunction(dpy, xafter);
+	XESetBeforeFlush(dpy, XAddExtension(dpy)->extension, xflushed);
 
 	class_hint.res_name = wmname;
 	class_hint.res_class = "tabbed";
@@ -1118,39 +2121,109 @@ setup(void)
 	snprintf(winid, sizeof(winid), "%lu", win);
 	setenv("XEMBED", winid, 1);
 
+	if (poolsize > 0) {
+		pool = ecalloc(poolsize, sizeof(*pool));
+		poolpids = ecalloc(poolsize, sizeof(*poolpids));
+	}
+
 	nextfocus = foreground;
 	focus(-1);
 }
 
+/* Arms timer t to fire in ms milliseconds, unless it is due earlier. */
 void
-sigchld(int unused)
+settimer(int t, int ms)
 {
-	if (signal(SIGCHLD, sigchld) == SIG_ERR)
-		die("%s: cannot install SIGCHLD handler", argv0);
+	long long due = timems() + MAX(ms, 0);
 
-	while (0 < waitpid(-1, NULL, WNOHANG));
+	if (!timerdue[t] || due < timerdue[t])
+		timerdue[t] = due;
+}
+
+void
+sigcrash(int sig)
+{
+	tracedump();
+	raise(sig);
+}
+
+void
+sighandler(int sig)
+{
+	int olderrno = errno;
+	unsigned char c = sig;
+
+	write(sigpipe[1], &c, 1);
+	errno = olderrno;
+}
+
+void
+signals(void)
+{
+	unsigned char c;
+	pid_t pid;
+	int i;
+
+	while (read(sigpipe[0], &c, 1) == 1) {
+		switch (c) {
+		case SIGCHLD:
+			while (0 < (pid = waitpid(-1, NULL, WNOHANG))) {
+				/* died before embedding, not refilled on
+				 * purpose so a failing cmd cannot loop */
+				for (i = 0; i < npoolpids; i++) {
+					if (poolpids[i] == pid)
+						poolpids[i--] = poolpids[--npoolpids];
+				}
+			}
+			break;
+		case SIGUSR1:
+			dumpstats();
+			break;
+		case SIGUSR2:
+			tracedump();
+			break;
+		}
+	}
 }
 
 void
 spawn(const Arg *arg)
 {
-	if (fork() == 0) {
-		if(dpy)
-			close(ConnectionNumber(dpy));
+	Window w;
+	int prev = actstart(ActSpawn);
 
-		setsid();
-		if (arg && arg->v) {
-			execvp(((char **)arg->v)[0], (char **)arg->v);
-			fprintf(stderr, "%s: execvp %s", argv0,
-			        ((char **)arg->v)[0]);
+	if (arg && arg->v) {
+		forkcmd((char **)arg->v);
+		curact = prev;
+		return;
+	}
+
+	cmd[cmd_append_pos] = NULL;
+	if (poolsize > 0 && !pooloff && cmd[0]) {
+		if (npool) {
+			stats.poolhits++;
+			w = pool[0];
+			npool--;
+			memmove(&pool[0], &pool[1], sizeof(*pool) * npool);
+			addtab(w);
 		} else {
-			cmd[cmd_append_pos] = NULL;
-			execvp(cmd[0], cmd);
-			fprintf(stderr, "%s: execvp %s", argv0, cmd[0]);
+			stats.poolmisses++;
+			forkcmd(cmd);
 		}
-		perror(" failed");
-		exit(0);
+		poolfill();
+	} else {
+		forkcmd(cmd);
 	}
+	curact = prev;
+}
+
+int
+textextent(const char *text, Extents *e, int i)
+{
+	if (e->w[i] < 0)
+		e->w[i] = textnw(text, e->off[i]);
+
+	return e->w[i];
 }
 
 int
@@ -1161,69 +2234,223 @@ textnw(const char *text, unsigned int len)
 	return ext.xOff;
 }
 
+long long
+timems(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/* Returns the monotonic clock in microseconds. */
+long long
+timeus(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* Updates the title of c, unless it was updated less than the configured
+ * interval ago, then the update is deferred to updatetitles().  */
+void
+titlechanged(int c)
+{
+	long long t = timems();
+
+	int interval = c == tabs.sel ? seltitleinterval : titleinterval;
+
+	if (t - clients[c]->titlet >= interval) {
+		clients[c]->titlet = t;
+		updatetitle(c);
+	} else if (clients[c]->titlepending) {
+		stats.titlesdropped++;
+	} else {
+		clients[c]->titlepending = True;
+		ntitlespending++;
+		settimer(TitleTimer, clients[c]->titlet + interval - t);
+	}
+}
+
+/* Fires the timers which are due.  Returns the milliseconds until the
+ * next one is, -1 if no timer is armed.  */
+int
+timersrun(void)
+{
+	int i, next = -1;
+	long long t = timems();
+
+	for (i = 0; i < TimerLast; i++) {
+		if (timerdue[i] && timerdue[i] <= t) {
+			timerdue[i] = 0;
+			timer[i]();
+		}
+	}
+
+	t = timems();
+	for (i = 0; i < TimerLast; i++) {
+		if (timerdue[i] && (next < 0 || timerdue[i] - t < next))
+			next = MAX(0, timerdue[i] - t);
+	}
+
+	return next;
+}
+
 void
 toggle(const Arg *arg)
 {
     *(Bool*) arg->v = !*(Bool*) arg->v;
 }
 
+/* Records e, read at t, with no time spent handling it so far. */
 void
-unmanage(int c)
+traceadd(const XEvent *e, long long t)
 {
-	if (c < 0 || c >= nclients) {
-		drawbar();
-		XSync(dpy, False);
-		return;
+	TraceEvent *te = &trace[ntrace++ % tracelen];
+	Atom a;
+
+	te->t = t;
+	te->dur = 0;
+	te->type = e->type;
+	te->win = e->xany.window;
+	te->a = te->b = 0;
+	switch (e->type) {
+	case ButtonPress:
+		te->a = e->xbutton.button;
+		te->b = e->xbutton.x;
+		break;
+	case ConfigureNotify:
+		te->win = e->xconfigure.window;
+		te->a = e->xconfigure.width;
+		te->b = e->xconfigure.height;
+		break;
+	case ConfigureRequest:
+		te->win = e->xconfigurerequest.window;
+		break;
+	case CreateNotify:
+		te->win = e->xcreatewindow.window;
+		break;
+	case DestroyNotify:
+		te->win = e->xdestroywindow.window;
+		break;
+	case KeyPress:
+		te->a = e->xkey.keycode;
+		te->b = e->xkey.state;
+		break;
+	case MapRequest:
+		te->win = e->xmaprequest.window;
+		break;
+	case PropertyNotify:
+		/* other atoms differ between X servers */
+		a = e->xproperty.atom;
+		if (a == wmatom[WMSelectTab])
+			te->a = TRACESELECTTAB;
+		else if (a == wmatom[WMName])
+			te->a = XA_WM_NAME;
+		else if (a <= XA_LAST_PREDEFINED)
+			te->a = a;
+		te->b = e->xproperty.state;
+		break;
+	case UnmapNotify:
+		te->win = e->xunmap.window;
+		break;
 	}
+	te->selwin = tabs.sel >= 0 && tabs.sel < tabs.n ?
+	             clients[tabs.sel]->win : None;
+}
+
+/* Completes entry n once its event was handled, unless it was already
+ * overwritten.  */
+void
+tracedone(unsigned long n, long long dur)
+{
+	TraceEvent *te = &trace[n % tracelen];
 
-	if (!nclients)
+	if (ntrace - n > tracelen)
 		return;
+	te->dur = dur;
+	te->selwin = tabs.sel >= 0 && tabs.sel < tabs.n ?
+	             clients[tabs.sel]->win : None;
+}
 
-	if (c == 0) {
-		/* First client. */
-		nclients--;
-		free(clients[0]);
-		memmove(&clients[0], &clients[1], sizeof(Client *) * nclients);
-	} else if (c == nclients - 1) {
-		/* Last client. */
-		nclients--;
-		free(clients[c]);
-		clients = erealloc(clients, sizeof(Client *) * nclients);
-	} else {
-		/* Somewhere inbetween. */
-		free(clients[c]);
-		memmove(&clients[c], &clients[c+1],
-		        sizeof(Client *) * (nclients - (c + 1)));
-		nclients--;
+/* Writes the flight recorder to tracefile, oldest event first.  Only uses
+ * async-signal-safe calls, so it can run from sigcrash().  */
+void
+tracedump(void)
+{
+	TraceHeader h;
+	unsigned long i;
+	int fd;
+
+	if (!trace || (fd = open(tracefile, O_WRONLY | O_CREAT | O_TRUNC,
+	                         0600)) < 0)
+		return;
+
+	memcpy(h.magic, TRACEMAGIC, sizeof(h.magic));
+	h.n = MIN(ntrace, tracelen);
+	h.win = win;
+	i = ntrace > tracelen ? ntrace % tracelen : 0;
+	/* a partial trace would not load, leave none */
+	if (!tracewrite(fd, &h, sizeof(h)) ||
+	    !tracewrite(fd, &trace[i], (h.n - i) * sizeof(*trace)) ||
+	    !tracewrite(fd, trace, i * sizeof(*trace)))
+		unlink(tracefile);
+	close(fd);
+}
+
+/* Writes all n bytes at p, returns False on error. */
+Bool
+tracewrite(int fd, const void *p, size_t n)
+{
+	ssize_t w;
+
+	while (n > 0) {
+		if ((w = write(fd, p, n)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return False;
+		}
+		p = (const char *)p + w;
+		n -= w;
+	}
+
+	return True;
+}
+
+void
+unmanage(int c)
+{
+	int next, prev;
+
+	if (c < 0 || c >= tabs.n) {
+		redraw = True;
+		return;
 	}
 
-	if (nclients <= 0) {
-		lastsel = sel = -1;
+	if (!tabs.n)
+		return;
 
+	prev = actstart(ActClose);
+	indexdel(clients[c]->win);
+	if (clients[c]->titlepending)
+		ntitlespending--;
+	clientfree(clients[c]);
+	next = tabsremove(&tabs, c);
+	reindex(c, tabs.n);
+
+	if (next < 0) {
 		if (closelastclient)
 			running = False;
 		else if (fillagain && running)
 			spawn(NULL);
 	} else {
-		if (lastsel >= nclients)
-			lastsel = nclients - 1;
-		else if (lastsel > c)
-			lastsel--;
-
-		if (c == sel && lastsel >= 0) {
-			focus(lastsel);
-		} else {
-			if (sel > c)
-				sel--;
-			if (sel >= nclients)
-				sel = nclients - 1;
-
-			focus(sel);
-		}
+		focus(next);
 	}
 
-	drawbar();
-	XSync(dpy, False);
+	redraw = True;
+	curact = prev;
 }
 
 void
@@ -1236,6 +2463,32 @@ unmapnotify(const XEvent *e)
 		unmanage(c);
 }
 
+/* Rebuilds the keycode dispatch table and grabs the keys on win, which
+ * covers the embedded clients as they are its descendants.  */
+void
+updatekeys(void)
+{
+	unsigned int i, j;
+	unsigned int modifiers[] = { 0, LockMask, 0, LockMask };
+	KeyCode code;
+
+	updatenumlockmask();
+	modifiers[2] = numlockmask;
+	modifiers[3] = numlockmask | LockMask;
+
+	memset(keyhead, 0, sizeof(keyhead));
+	XUngrabKey(dpy, AnyKey, AnyModifier, win);
+	for (i = LENGTH(keys); i-- > 0;) {
+		if (!(code = XKeysymToKeycode(dpy, keys[i].keysym)))
+			continue;
+		keynext[i] = keyhead[code];
+		keyhead[code] = i + 1;
+		for (j = 0; j < LENGTH(modifiers); j++)
+			XGrabKey(dpy, code, keys[i].mod | modifiers[j], win,
+			         True, GrabModeAsync, GrabModeAsync);
+	}
+}
+
 void
 updatenumlockmask(void)
 {
@@ -1257,18 +2510,127 @@ updatenumlockmask(void)
 void
 updatetitle(int c)
 {
-	if (!gettextprop(clients[c]->win, wmatom[WMName], clients[c]->name,
-	    sizeof(clients[c]->name)))
-		gettextprop(clients[c]->win, XA_WM_NAME, clients[c]->name,
-		            sizeof(clients[c]->name));
-	if (sel == c)
+	char name[sizeof(clients[c]->name)];
+	int prev = actstart(ActRetitle);
+
+	if (!gettextprop(clients[c]->win, wmatom[WMName], name, sizeof(name)))
+		gettextprop(clients[c]->win, XA_WM_NAME, name, sizeof(name));
+
+	/* shells like to set the same title on every prompt */
+	if (!strcmp(name, clients[c]->name)) {
+		curact = prev;
+		return;
+	}
+
+	memcpy(clients[c]->name, name, sizeof(name));
+	clients[c]->tabnum = 0;
+	if (tabs.sel == c)
 		xsettitle(win, clients[c]->name);
-	drawbar();
+	redraw = True;
+	curact = prev;
+}
+
+/* Applies the deferred titles which are due and rearms TitleTimer for
+ * the next one.  */
+void
+updatetitles(void)
+{
+	int c;
+	long long t = timems(), due;
+
+	for (c = 0; c < tabs.n && ntitlespending; c++) {
+		if (!clients[c]->titlepending)
+			continue;
+		due = clients[c]->titlet + (c == tabs.sel ? seltitleinterval :
+		                            titleinterval);
+		if (due <= t) {
+			clients[c]->titlepending = False;
+			clients[c]->titlet = t;
+			ntitlespending--;
+			updatetitle(c);
+		} else {
+			settimer(TitleTimer, due - t);
+		}
+	}
+}
+
+/* Returns the length of the longest prefix of s made of complete, valid
+ * UTF-8 sequences.  Runs of ASCII are skipped eight bytes at a time.  */
+size_t
+utf8len(const unsigned char *s, size_t n)
+{
+	size_t i = 0, k, len;
+	unsigned long long v;
+
+	while (i < n) {
+		if (n - i >= sizeof(v)) {
+			memcpy(&v, &s[i], sizeof(v));
+			if (!(v & 0x8080808080808080ULL)) {
+				i += sizeof(v);
+				continue;
+			}
+		}
+		if (s[i] < 0x80) {
+			i++;
+			continue;
+		}
+
+		if (s[i] >= 0xc2 && s[i] <= 0xdf)
+			len = 2;
+		else if (s[i] >= 0xe0 && s[i] <= 0xef)
+			len = 3;
+		else if (s[i] >= 0xf0 && s[i] <= 0xf4)
+			len = 4;
+		else
+			break;
+		if (n - i < len)
+			break;
+		for (k = 1; k < len && (s[i + k] & 0xc0) == 0x80; k++)
+			;
+		if (k < len)
+			break;
+		/* overlong forms, surrogates and codepoints past U+10FFFF */
+		if ((s[i] == 0xe0 && s[i + 1] < 0xa0) ||
+		    (s[i] == 0xed && s[i + 1] > 0x9f) ||
+		    (s[i] == 0xf0 && s[i + 1] < 0x90) ||
+		    (s[i] == 0xf4 && s[i + 1] > 0x8f))
+			break;
+		i += len;
+	}
+
+	return i;
+}
+
+/* Called by Xlib after every request.  If the server has answered the
+ * latest request, the call had to wait for a reply: count a round trip
+ * against the handler currently running.  */
+int
+xafter(Display *dpy)
+{
+	unsigned long r = LastKnownRequestProcessed(dpy);
+	unsigned long req = NextRequest(dpy) - 1;
+	unsigned long bytes = xsent + (dpy->bufptr - dpy->buffer);
+	Traffic *t[] = { &stats.evx[curev], &stats.actx[curact] };
+	int i;
+
+	for (i = 0; i < LENGTH(t); i++) {
+		t[i]->requests += req - lastreq;
+		t[i]->bytes += bytes - lastbytes;
+		if (r != lastread && r == req)
+			t[i]->roundtrips++;
+	}
+	lastread = r;
+	lastreq = req;
+	lastbytes = bytes;
+
+	return 0;
 }
 
 /* There's no way to check accesses to destroyed windows, thus those cases are
  * ignored (especially on UnmapNotify's).  Other types of errors call Xlibs
- * default error handler, which may call exit.  */
+ * default error handler, which may call exit.  Requests are not synced, so
+ * errors arrive asynchronously; Xlib matches them to the failed request by
+ * sequence number, which is what fills in ee->request_code.  */
 int
 xerror(Display *dpy, XErrorEvent *ee)
 {
@@ -1288,14 +2650,40 @@ xerror(Display *dpy, XErrorEvent *ee)
 	    || (ee->request_code == X_GrabKey &&
 	        ee->error_code == BadAccess)
 	    || (ee->request_code == X_CopyArea &&
-	        ee->error_code == BadDrawable))
+	        ee->error_code == BadDrawable)) {
+		stats.xerrors++;
 		return 0;
+	}
 
 	fprintf(stderr, "%s: fatal error: request code=%d, error code=%d\n",
 	        argv0, ee->request_code, ee->error_code);
 	return xerrorxlib(dpy, ee); /* may call exit */
 }
 
+pid_t
+winpid(Window w)
+{
+	Atom type;
+	int format;
+	unsigned long n, after;
+	unsigned char *p = NULL;
+	pid_t pid = 0;
+
+	if (XGetWindowProperty(dpy, w, wmatom[WMPid], 0L, 1L, False,
+	                       XA_CARDINAL, &type, &format, &n, &after,
+	                       &p) == Success && p && n == 1 && format == 32)
+		pid = *(long *)p;
+	XFree(p);
+
+	return pid;
+}
+
+void
+xflushed(Display *dpy, XExtCodes *codes, const char *data, long len)
+{
+	xsent += len;
+}
+
 void
 xsettitle(Window w, const char *str)
 {
@@ -0,0 +1,343 @@
+/*
+ * See LICENSE file for copyright and license details.
+ *
+ * tabbench drives a running tabbed through X the way embedded clients do
+ * and reports how fast tabs are managed, switched, retitled, resized and
+ * closed.  Given the pid and stderr log of tabbed, it also reads the bar
+ * repaints and X requests per operation from its SIGUSR1 statistics.
+ */
+
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "arg.h"
+
+#define XEMBED_WINDOW_ACTIVATE  1
+#define TIMEOUT                 10000 /* ms to wait for tabbed */
+
+typedef struct {
+	unsigned long frames, requests;
+} Counters;
+
+static int cmplong(const void *a, const void *b);
+static void die(const char *errstr, ...);
+static void idle(void);
+static void nextevent(XEvent *ev);
+static long now(void);
+static void readstats(Counters *c);
+static void report(const char *op, long t, int n, long *lat,
+                   const Counters *c0);
+static void selecttab(Window w);
+static void settle(void);
+static void usage(void);
+static void waitactivate(Window w);
+
+char *argv0;
+static Display *dpy;
+static Window tabbed;
+static Window *tabs;
+static long *lat;
+static int ntabs = 10, rounds = 100;
+static pid_t pid; /* of tabbed */
+static char *logpath; /* where its stderr goes */
+static Atom xembed, selecttabatom;
+
+int
+cmplong(const void *a, const void *b)
+{
+	long x = *(const long *)a, y = *(const long *)b;
+
+	return (x > y) - (x < y);
+}
+
+void
+die(const char *errstr, ...)
+{
+	va_list ap;
+
+	va_start(ap, errstr);
+	vfprintf(stderr, errstr, ap);
+	va_end(ap);
+	exit(EXIT_FAILURE);
+}
+
+/* Selects the first tab and waits for it, so everything sent before has
+ * been handled by tabbed.  */
+void
+idle(void)
+{
+	selecttab(tabs[0]);
+	waitactivate(tabs[0]);
+}
+
+void
+nextevent(XEvent *ev)
+{
+	struct pollfd pfd = { .fd = ConnectionNumber(dpy), .events = POLLIN };
+
+	while (!XPending(dpy)) {
+		if (poll(&pfd, 1, TIMEOUT) <= 0)
+			die("%s: timed out waiting for tabbed\n", argv0);
+	}
+	XNextEvent(dpy, ev);
+}
+
+/* Returns the monotonic clock in microseconds. */
+long
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+/* Makes tabbed dump its statistics and picks the counters out of the
+ * log.  "x requests" is the last line of the dump.  */
+void
+readstats(Counters *c)
+{
+	char line[BUFSIZ];
+	long off, t;
+	Bool done = False;
+	FILE *fp;
+
+	memset(c, 0, sizeof(*c));
+	if (!pid || !logpath || !(fp = fopen(logpath, "r")))
+		return;
+	fseek(fp, 0, SEEK_END);
+	off = ftell(fp);
+	fclose(fp);
+
+	kill(pid, SIGUSR1);
+	for (t = now(); !done && now() - t < TIMEOUT * 1000L; ) {
+		usleep(1000);
+		if (!(fp = fopen(logpath, "r")))
+			return;
+		fseek(fp, off, SEEK_SET);
+		while (fgets(line, sizeof(line), fp)) {
+			if (strstr(line, " bar frames "))
+				c->frames = strtoul(strrchr(line, ' '), NULL,
+				                    10);
+			if (strstr(line, " x requests ")) {
+				c->requests = strtoul(strrchr(line, ' '), NULL,
+				                      10);
+				done = True;
+			}
+		}
+		fclose(fp);
+	}
+}
+
+/* Prints one line for n operations that took t microseconds, with the
+ * latency percentiles when lat is given.  */
+void
+report(const char *op, long t, int n, long *lat, const Counters *c0)
+{
+	Counters c;
+
+	readstats(&c);
+	printf("%5d tabs %-8s %10.0f/s", ntabs, op, t ? n * 1e6 / t : 0.0);
+	if (lat) {
+		qsort(lat, n, sizeof(*lat), cmplong);
+		printf(" p50 %6ldus p90 %6ldus p99 %6ldus max %6ldus",
+		       lat[n / 2], lat[n * 9 / 10], lat[n * 99 / 100],
+		       lat[n - 1]);
+	}
+	if (pid)
+		printf(" frames/op %7.2f requests/op %8.2f",
+		       (double)(c.frames - c0->frames) / n,
+		       (double)(c.requests - c0->requests) / n);
+	putchar('\n');
+	fflush(stdout);
+}
+
+void
+selecttab(Window w)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "0x%lx", w);
+	XChangeProperty(dpy, tabbed, selecttabatom, XA_STRING, 8,
+	                PropModeReplace, (unsigned char *)buf, strlen(buf));
+	XFlush(dpy);
+}
+
+/* Discards events until tabbed has been quiet for a while, so none of
+ * them is taken as the answer to a later request.  */
+void
+settle(void)
+{
+	struct pollfd pfd = { .fd = ConnectionNumber(dpy), .events = POLLIN };
+	XEvent ev;
+
+	XSync(dpy, False);
+	do {
+		while (XPending(dpy))
+			XNextEvent(dpy, &ev);
+	} while (poll(&pfd, 1, 50) > 0);
+}
+
+void
+usage(void)
+{
+	die("usage: %s [-n tabs] [-r rounds] [-p pid -l log] xid\n", argv0);
+}
+
+/* Waits until tabbed activates the tab w. */
+void
+waitactivate(Window w)
+{
+	XEvent ev;
+
+	do {
+		nextevent(&ev);
+	} while (ev.type != ClientMessage || ev.xclient.window != w ||
+	         ev.xclient.message_type != xembed ||
+	         ev.xclient.data.l[1] != XEMBED_WINDOW_ACTIVATE);
+}
+
+int
+main(int argc, char *argv[])
+{
+	XSetWindowAttributes wa;
+	XWMHints wmh = { .flags = 0 };
+	XEvent ev;
+	Counters c0;
+	Window w;
+	char buf[64], *name;
+	long t, t0;
+	int i, n;
+
+	ARGBEGIN {
+	case 'l':
+		logpath = EARGF(usage());
+		break;
+	case 'n':
+		ntabs = atoi(EARGF(usage()));
+		break;
+	case 'p':
+		pid = atoi(EARGF(usage()));
+		break;
+	case 'r':
+		rounds = atoi(EARGF(usage()));
+		break;
+	default:
+		usage();
+	} ARGEND;
+
+	if (argc != 1 || ntabs < 1 || rounds < 1)
+		usage();
+	tabbed = strtoul(argv[0], NULL, 0);
+	if (!(dpy = XOpenDisplay(NULL)))
+		die("%s: cannot open display\n", argv0);
+	xembed = XInternAtom(dpy, "_XEMBED", False);
+	selecttabatom = XInternAtom(dpy, "_TABBED_SELECT_TAB", False);
+	XSelectInput(dpy, tabbed, PropertyChangeMask);
+
+	if (!(tabs = calloc(ntabs, sizeof(*tabs))) ||
+	    !(lat = calloc(rounds, sizeof(*lat))))
+		die("%s: cannot allocate memory\n", argv0);
+
+	/* manage: tabbed adopts every child window created in it */
+	readstats(&c0);
+	wa.event_mask = StructureNotifyMask;
+	t0 = now();
+	for (i = 0; i < ntabs; i++) {
+		tabs[i] = XCreateWindow(dpy, tabbed, 0, 0, 1, 1, 0,
+		                        CopyFromParent, InputOutput,
+		                        CopyFromParent, CWEventMask, &wa);
+		snprintf(buf, sizeof(buf), "tab %d", i);
+		XStoreName(dpy, tabs[i], buf);
+	}
+	XFlush(dpy);
+	for (n = 0; n < ntabs; ) {
+		nextevent(&ev);
+		if (ev.type == MapNotify && ev.xmap.window != tabbed)
+			n++;
+	}
+	report("manage", now() - t0, ntabs, NULL, &c0);
+
+	/* switch: time from the request to the XEmbed activation */
+	settle();
+	readstats(&c0);
+	t0 = now();
+	for (i = 0; i < rounds; i++) {
+		t = now();
+		w = tabs[rand() % ntabs];
+		selecttab(w);
+		waitactivate(w);
+		lat[i] = now() - t;
+	}
+	report("switch", now() - t0, rounds, lat, &c0);
+
+	/* retitle: mostly hidden tabs, whose updates are rate limited */
+	settle();
+	readstats(&c0);
+	t0 = now();
+	for (i = 0; i < rounds; i++) {
+		snprintf(buf, sizeof(buf), "title %d", i);
+		XStoreName(dpy, tabs[i % ntabs], buf);
+	}
+	idle();
+	report("retitle", now() - t0, rounds, NULL, &c0);
+
+	/* urgency: set and clear the hint on tabs */
+	settle();
+	readstats(&c0);
+	t0 = now();
+	for (i = 0; i < rounds; i++) {
+		wmh.flags = i % 2 ? 0 : XUrgencyHint;
+		XSetWMHints(dpy, tabs[i / 2 % ntabs], &wmh);
+	}
+	idle();
+	report("urgency", now() - t0, rounds, NULL, &c0);
+
+	/* resize: time until the selected first tab has the new width */
+	settle();
+	readstats(&c0);
+	t0 = now();
+	for (i = 0; i < rounds; i++) {
+		t = now();
+		n = 640 + i % 256;
+		XResizeWindow(dpy, tabbed, n, 600);
+		XFlush(dpy);
+		do {
+			nextevent(&ev);
+		} while (ev.type != ConfigureNotify || ev.xconfigure.window !=
+		         tabs[0] || ev.xconfigure.width != n);
+		lat[i] = now() - t;
+	}
+	report("resize", now() - t0, rounds, lat, &c0);
+
+	/* close: tabbed names itself after its command once it is empty */
+	settle();
+	readstats(&c0);
+	t0 = now();
+	for (i = 0; i < ntabs; i++)
+		XDestroyWindow(dpy, tabs[i]);
+	XFlush(dpy);
+	for (n = 0; !n; ) {
+		nextevent(&ev);
+		if (ev.type != PropertyNotify || ev.xproperty.window != tabbed ||
+		    ev.xproperty.atom != XA_WM_NAME)
+			continue;
+		if (XFetchName(dpy, tabbed, &name)) {
+			n = !strncmp(name, "tabbed-", 7);
+			XFree(name);
+		}
+	}
+	report("close", now() - t0, ntabs, NULL, &c0);
+
+	XCloseDisplay(dpy);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+/*
+ * See LICENSE file for copyright and license details.
+ *
+ * tabreplay feeds a trace written by the flight recorder of tabbed into
+ * another running tabbed, typically on Xvfb: the recorded clients are
+ * created, retitled, marked urgent, selected and destroyed, and tabbed is
+ * resized, with the recorded timing unless -f is given.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "arg.h"
+#include "trace.h"
+
+typedef struct {
+	unsigned long from; /* recorded window */
+	Window to;
+	Bool urgent;
+} Map;
+
+static void die(const char *errstr, ...);
+static Map *getmap(unsigned long w);
+static long long now(void);
+static void usage(void);
+
+char *argv0;
+static Display *dpy;
+static Map *maps;
+static int nmaps;
+
+void
+die(const char *errstr, ...)
+{
+	va_list ap;
+
+	va_start(ap, errstr);
+	vfprintf(stderr, errstr, ap);
+	va_end(ap);
+	exit(EXIT_FAILURE);
+}
+
+Map *
+getmap(unsigned long w)
+{
+	int i;
+
+	for (i = 0; i < nmaps; i++) {
+		if (maps[i].from == w)
+			return &maps[i];
+	}
+
+	return NULL;
+}
+
+/* Returns the monotonic clock in microseconds. */
+long long
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+void
+usage(void)
+{
+	die("usage: %s [-f] file xid\n", argv0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	TraceHeader h;
+	TraceEvent te;
+	XWMHints wmh;
+	Window tabbed, selwin = None;
+	Atom selecttab;
+	Map *m;
+	FILE *fp;
+	Bool fast = False;
+	char buf[64];
+	long long t0 = 0, start = 0, d;
+	unsigned long i, titles = 0;
+
+	ARGBEGIN {
+	case 'f':
+		fast = True;
+		break;
+	default:
+		usage();
+	} ARGEND;
+
+	if (argc != 2)
+		usage();
+	if (!(fp = fopen(argv[0], "rb")))
+		die("%s: cannot open %s\n", argv0, argv[0]);
+	if (fread(&h, sizeof(h), 1, fp) != 1 ||
+	    memcmp(h.magic, TRACEMAGIC, sizeof(h.magic)))
+		die("%s: %s is not a tabbed trace\n", argv0, argv[0]);
+	tabbed = strtoul(argv[1], NULL, 0);
+	if (!(dpy = XOpenDisplay(NULL)))
+		die("%s: cannot open display\n", argv0);
+	selecttab = XInternAtom(dpy, "_TABBED_SELECT_TAB", False);
+
+	for (i = 0; i < h.n && fread(&te, sizeof(te), 1, fp) == 1; i++) {
+		if (!fast) {
+			if (!i) {
+				t0 = te.t;
+				start = now();
+			}
+			if ((d = te.t - t0 - (now() - start)) > 0)
+				usleep(d);
+		}
+
+		m = getmap(te.win);
+		switch (te.type) {
+		case CreateNotify:
+		case MapRequest:
+			if (m || te.win == h.win)
+				break;
+			if (!(maps = realloc(maps, sizeof(*maps) * (nmaps + 1))))
+				die("%s: cannot allocate memory\n", argv0);
+			m = &maps[nmaps++];
+			m->from = te.win;
+			m->to = XCreateSimpleWindow(dpy, tabbed, 0, 0, 1, 1, 0,
+			                            0, 0);
+			m->urgent = False;
+			snprintf(buf, sizeof(buf), "client 0x%lx", te.win);
+			XStoreName(dpy, m->to, buf);
+			break;
+		case DestroyNotify:
+		case UnmapNotify:
+			if (!m)
+				break;
+			XDestroyWindow(dpy, m->to);
+			*m = maps[--nmaps];
+			break;
+		case ConfigureNotify:
+			if (te.win == h.win)
+				XResizeWindow(dpy, tabbed, te.a, te.b);
+			break;
+		case PropertyNotify:
+			if (!m || te.b != PropertyNewValue)
+				break;
+			if (te.a == XA_WM_NAME) {
+				snprintf(buf, sizeof(buf), "title %lu", titles++);
+				XStoreName(dpy, m->to, buf);
+			} else if (te.a == XA_WM_HINTS) {
+				m->urgent = !m->urgent;
+				wmh.flags = m->urgent ? XUrgencyHint : 0;
+				XSetWMHints(dpy, m->to, &wmh);
+			}
+			break;
+		}
+
+		/* tabbed selects new tabs and refocuses after closing one on
+		 * its own, other switches were asked for */
+		if (te.selwin != selwin && (te.type == KeyPress ||
+		    te.type == ButtonPress || te.type == PropertyNotify) &&
+		    (m = getmap(te.selwin))) {
+			snprintf(buf, sizeof(buf), "0x%lx", m->to);
+			XChangeProperty(dpy, tabbed, selecttab, XA_STRING, 8,
+			                PropModeReplace, (unsigned char *)buf,
+			                strlen(buf));
+		}
+		selwin = te.selwin;
+		XFlush(dpy);
+	}
+
+	fclose(fp);
+	XSync(dpy, False);
+	XCloseDisplay(dpy);
+	return EXIT_SUCCESS;
+}
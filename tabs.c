@@ -0,0 +1,173 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tabs.h"
+
+#define ITEM(t, i)      ((char *)(t)->v + (size_t)(i) * (t)->size)
+
+/* Returns the visible tab at x, -1 if there is none.  The tabs share
+ * v->w equally, the selected one gets what is left over.  */
+int
+tabsat(const Tabs *t, const TabsView *v, int x)
+{
+	int q, r, s, i;
+
+	if (v->cc <= 0 || x < v->x || x >= v->x + v->w)
+		return -1;
+
+	x -= v->x;
+	if (!(q = v->w / v->cc))
+		return -1;
+	r = v->w % v->cc;
+	i = v->fc + x / q;
+	if (t->sel >= v->fc && t->sel < v->fc + v->cc) {
+		s = (t->sel - v->fc) * q;
+		if (x >= s + q + r)
+			i = t->sel + 1 + (x - s - q - r) / q;
+		else if (x >= s)
+			i = t->sel;
+	}
+
+	return i < v->fc + v->cc && i < t->n ? i : -1;
+}
+
+/* Returns the first visible tab if cc fit, keeping the selected one in
+ * the middle.  */
+int
+tabsfirst(const Tabs *t, int cc)
+{
+	int ret;
+
+	if (t->sel < 0)
+		return 0;
+
+	ret = t->sel - cc / 2 + (cc + 1) % 2;
+	return ret < 0 ? 0 :
+	       ret + cc > t->n ? (t->n > cc ? t->n - cc : 0) :
+	       ret;
+}
+
+/* Inserts item at pos, clamped to the ends.  Returns where it went or -1
+ * if out of memory.  */
+int
+tabsinsert(Tabs *t, const void *item, int pos)
+{
+	void *v;
+	int cap;
+
+	if (t->n == t->cap) {
+		/* one extra item is scratch space for tabsmove() */
+		cap = t->cap ? t->cap * 2 : 16;
+		if (!(v = realloc(t->v, (size_t)(cap + 1) * t->size)))
+			return -1;
+		t->v = v;
+		t->cap = cap;
+	}
+
+	pos = pos < 0 ? 0 : pos > t->n ? t->n : pos;
+	memmove(ITEM(t, pos + 1), ITEM(t, pos), (t->n - pos) * t->size);
+	memcpy(ITEM(t, pos), item, t->size);
+	t->n++;
+	if (t->sel >= pos)
+		t->sel++;
+	if (t->lastsel >= pos)
+		t->lastsel++;
+
+	return pos;
+}
+
+void
+tabsmove(Tabs *t, int from, int to)
+{
+	int *p[] = { &t->sel, &t->lastsel };
+	int i;
+
+	if (from == to)
+		return;
+
+	memcpy(ITEM(t, t->cap), ITEM(t, from), t->size);
+	if (from < to)
+		memmove(ITEM(t, from), ITEM(t, from + 1), (to - from) * t->size);
+	else
+		memmove(ITEM(t, to + 1), ITEM(t, to), (from - to) * t->size);
+	memcpy(ITEM(t, to), ITEM(t, t->cap), t->size);
+
+	for (i = 0; i < 2; i++) {
+		if (*p[i] == from)
+			*p[i] = to;
+		else if (from < to && *p[i] > from && *p[i] <= to)
+			(*p[i])--;
+		else if (from > to && *p[i] >= to && *p[i] < from)
+			(*p[i])++;
+	}
+}
+
+/* Removes tab i.  Returns the tab to select instead, -1 if none is left.
+ * The last selected one is preferred if i was selected.  */
+int
+tabsremove(Tabs *t, int i)
+{
+	memmove(ITEM(t, i), ITEM(t, i + 1), (t->n - i - 1) * t->size);
+	if (--t->n <= 0) {
+		t->sel = t->lastsel = -1;
+		return -1;
+	}
+
+	if (t->lastsel >= t->n)
+		t->lastsel = t->n - 1;
+	else if (t->lastsel > i)
+		t->lastsel--;
+
+	if (i == t->sel && t->lastsel >= 0)
+		return t->lastsel;
+	if (t->sel > i)
+		t->sel--;
+	if (t->sel >= t->n)
+		t->sel = t->n - 1;
+
+	return t->sel;
+}
+
+/* Returns the tab step tabs away from i, wrapping around. */
+int
+tabsrotate(const Tabs *t, int i, int step)
+{
+	if (t->n <= 0)
+		return -1;
+
+	i = (i + step) % t->n;
+	return i < 0 ? i + t->n : i;
+}
+
+void
+tabsselect(Tabs *t, int i)
+{
+	if (t->sel != i) {
+		t->lastsel = t->sel;
+		t->sel = i;
+	}
+}
+
+/* Lays out the tabs on a bar of the given width, leaving room for the
+ * markers of hidden tabs when not all of them fit.  */
+void
+tabsview(const Tabs *t, TabsView *v, int width, int tabwidth, int beforew,
+         int afterw)
+{
+	int cc;
+
+	cc = width / tabwidth;
+	if (t->n > cc)
+		cc = (width - beforew - afterw) / tabwidth;
+	if (cc < 1)
+		cc = 1;
+
+	v->fc = tabsfirst(t, cc);
+	v->cc = cc < t->n ? cc : t->n;
+	v->before = v->fc > 0;
+	v->after = v->fc + v->cc < t->n;
+	v->x = v->before ? beforew : 0;
+	v->w = width - v->x - (v->after ? afterw : 0);
+}
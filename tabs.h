@@ -0,0 +1,30 @@
+/* See LICENSE file for copyright and license details. */
+
+/*
+ * Tab model: the order of the tabs, the selected and last selected one and
+ * which of them fit on the bar.  It knows nothing about X, items are
+ * opaque and size bytes each.
+ */
+
+typedef struct {
+	void *v; /* items in tab order */
+	size_t size; /* of an item */
+	int n, cap; /* number of items, allocated length of v */
+	int sel, lastsel; /* -1 if none */
+} Tabs;
+
+typedef struct {
+	int fc, cc; /* first visible tab, number of visible tabs */
+	int x, w; /* left edge and total width of the visible tabs */
+	int before, after; /* whether tabs are hidden left and right of them */
+} TabsView;
+
+int tabsat(const Tabs *t, const TabsView *v, int x);
+int tabsfirst(const Tabs *t, int cc);
+int tabsinsert(Tabs *t, const void *item, int pos);
+void tabsmove(Tabs *t, int from, int to);
+int tabsremove(Tabs *t, int i);
+int tabsrotate(const Tabs *t, int i, int step);
+void tabsselect(Tabs *t, int i);
+void tabsview(const Tabs *t, TabsView *v, int width, int tabwidth,
+              int beforew, int afterw);
@@ -0,0 +1,171 @@
+/*
+ * See LICENSE file for copyright and license details.
+ *
+ * tabsbench times the operations of the tab model without an X server:
+ * inserting, removing, moving, selecting tabs, hit-testing the bar and
+ * laying it out, for up to 100000 tabs.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "arg.h"
+#include "tabs.h"
+
+#define BARWIDTH        1920
+#define TABWIDTH        200
+#define MARKERWIDTH     30
+
+static void die(const char *errstr, ...);
+static long long now(void);
+static void report(int n, const char *op, long long t);
+static unsigned long rnd(void);
+static void run(int n);
+static void usage(void);
+
+char *argv0;
+static int ops = 10000;
+static unsigned long seed = 2463534242UL;
+
+void
+die(const char *errstr, ...)
+{
+	va_list ap;
+
+	va_start(ap, errstr);
+	vfprintf(stderr, errstr, ap);
+	va_end(ap);
+	exit(EXIT_FAILURE);
+}
+
+/* Returns the monotonic clock in nanoseconds. */
+long long
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void
+report(int n, const char *op, long long t)
+{
+	printf("%6d tabs %-8s %10.1f ns/op\n", n, op, (double)t / ops);
+}
+
+/* xorshift, the same sequence on every run */
+unsigned long
+rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed & 0xffffffffUL;
+}
+
+void
+run(int n)
+{
+	Tabs t = { .size = sizeof(int), .sel = -1, .lastsel = -1 };
+	TabsView v;
+	long long t0, sum = 0, want;
+	int i, item, *items, hits = 0;
+
+	for (i = 0; i < n; i++) {
+		if (tabsinsert(&t, &i, i) < 0)
+			die("%s: cannot allocate memory\n", argv0);
+	}
+	tabsselect(&t, n / 2);
+	want = (long long)n * (n - 1) / 2;
+
+	t0 = now();
+	for (i = 0; i < ops; i++) {
+		item = n + i;
+		want += item;
+		if (tabsinsert(&t, &item, rnd() % (t.n + 1)) < 0)
+			die("%s: cannot allocate memory\n", argv0);
+	}
+	report(n, "insert", now() - t0);
+
+	t0 = now();
+	for (i = 0; i < ops; i++) {
+		item = rnd() % t.n;
+		want -= ((int *)t.v)[item];
+		tabsselect(&t, tabsremove(&t, item));
+	}
+	report(n, "remove", now() - t0);
+
+	t0 = now();
+	for (i = 0; i < ops; i++)
+		tabsmove(&t, t.sel, tabsrotate(&t, t.sel, rnd() % 2 ? 1 : -1));
+	report(n, "movetab", now() - t0);
+
+	t0 = now();
+	for (i = 0; i < ops; i++)
+		tabsmove(&t, rnd() % t.n, rnd() % t.n);
+	report(n, "reorder", now() - t0);
+
+	t0 = now();
+	for (i = 0; i < ops; i++)
+		tabsselect(&t, tabsrotate(&t, t.sel, rnd() % 2 ? 1 : -1));
+	report(n, "rotate", now() - t0);
+
+	t0 = now();
+	for (i = 0; i < ops; i++) {
+		tabsselect(&t, rnd() % t.n);
+		tabsview(&t, &v, BARWIDTH, TABWIDTH, MARKERWIDTH, MARKERWIDTH);
+	}
+	report(n, "view", now() - t0);
+
+	t0 = now();
+	for (i = 0; i < ops; i++)
+		hits += tabsat(&t, &v, rnd() % BARWIDTH) >= 0;
+	report(n, "hittest", now() - t0);
+
+	/* the model must still hold what was put in */
+	for (i = 0; i < t.n; i++)
+		sum += ((int *)t.v)[i];
+	items = t.v;
+	if (t.n != n || sum != want || !hits || items[t.sel] < 0)
+		die("%s: tab model is inconsistent at %d tabs\n", argv0, n);
+	free(t.v);
+}
+
+void
+usage(void)
+{
+	die("usage: %s [-o ops] [tabs ...]\n", argv0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const int defaults[] = { 1, 10, 100, 1000, 10000, 100000 };
+	int i;
+
+	ARGBEGIN {
+	case 'o':
+		ops = atoi(EARGF(usage()));
+		break;
+	default:
+		usage();
+	} ARGEND;
+
+	if (ops < 1)
+		usage();
+	if (argc) {
+		for (i = 0; i < argc; i++) {
+			if (atoi(argv[i]) < 1)
+				usage();
+			run(atoi(argv[i]));
+		}
+	} else {
+		for (i = 0; i < sizeof(defaults) / sizeof(*defaults); i++)
+			run(defaults[i]);
+	}
+
+	return EXIT_SUCCESS;
+}
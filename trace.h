@@ -0,0 +1,27 @@
+/* See LICENSE file for copyright and license details. */
+
+/*
+ * Flight recorder file format, in host byte order: a TraceHeader followed
+ * by n TraceEvents in the order they arrived.
+ */
+
+#define TRACEMAGIC      "tbtrace1"
+#define TRACESELECTTAB  (-1L) /* a of a _TABBED_SELECT_TAB PropertyNotify */
+
+typedef struct {
+	char magic[8];
+	unsigned long n;
+	unsigned long win; /* of tabbed */
+} TraceHeader;
+
+typedef struct {
+	long long t; /* when it was read, in us */
+	long long dur; /* how long its handler ran, in us, 0 if coalesced */
+	int type;
+	unsigned long win;
+	/* PropertyNotify: predefined atom, TRACESELECTTAB or None, state;
+	 * ConfigureNotify: width, height; KeyPress: keycode, state;
+	 * ButtonPress: button, x */
+	long a, b;
+	unsigned long selwin; /* selected tab after the handler, or None */
+} TraceEvent;